@@ -0,0 +1,361 @@
+#include "Archive.h"
+#include "Logger.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include <zlib.h>
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+static const size_t TAR_BLOCK_SIZE = 512;
+
+static const uint32_t ZIP_LOCAL_HEADER = 0x04034b50;
+static const uint32_t ZIP_CENTRAL_HEADER = 0x02014b50;
+static const uint32_t ZIP_END_OF_CENTRAL_DIR = 0x06054b50;
+
+static bool endsWith(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static uint16_t readLE16(const char* p) {
+    const unsigned char* u = (const unsigned char*) p;
+    return u[0] | (u[1] << 8);
+}
+
+static uint32_t readLE32(const char* p) {
+    const unsigned char* u = (const unsigned char*) p;
+    return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t) u[3] << 24);
+}
+
+// NUL terminated within the field, or the whole field
+static std::string readField(const char* field, size_t length) {
+    return std::string(field, strnlen(field, length));
+}
+
+// Octal, or base-256 for large GNU sizes
+static uint64_t readTarNumber(const char* field, size_t length) {
+    uint64_t value = 0;
+
+    if ((unsigned char) field[0] & 0x80) {
+        for (size_t i = 1; i < length; i++) {
+            value = (value << 8) | (unsigned char) field[i];
+        }
+        return value;
+    }
+
+    for (size_t i = 0; i < length && field[i] != '\0'; i++) {
+        if (field[i] >= '0' && field[i] <= '7') {
+            value = value * 8 + (field[i] - '0');
+        }
+    }
+    return value;
+}
+
+// "<length> path=<value>\n" records
+static std::string readPaxPath(const std::string &records) {
+    size_t pos = 0;
+    while (pos < records.size()) {
+        size_t space = records.find(' ', pos);
+        if (space == std::string::npos) {
+            break;
+        }
+
+        size_t length = strtoul(records.c_str() + pos, nullptr, 10);
+        if (length == 0 || pos + length > records.size()) {
+            break;
+        }
+
+        std::string record = records.substr(space + 1, pos + length - space - 2);
+        if (record.compare(0, 5, "path=") == 0) {
+            return record.substr(5);
+        }
+        pos += length;
+    }
+
+    return "";
+}
+
+// Reads a .tar, compressed or not, since gzread() passes other files through
+class GzipReader {
+    gzFile file;
+
+public:
+    explicit GzipReader(const std::string &path) : file(gzopen(path.c_str(), "rb")) {
+        // nop
+    }
+
+    ~GzipReader() {
+        if (file) {
+            gzclose(file);
+        }
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    bool read(char* buffer, size_t length) {
+        while (length > 0) {
+            int n = gzread(file, buffer, length > (1u << 30) ? (1u << 30) : (unsigned) length);
+            if (n <= 0) {
+                return false;
+            }
+            buffer += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    bool skip(uint64_t length) {
+        char buffer[64 * 1024];
+        while (length > 0) {
+            size_t n = length < sizeof(buffer) ? length : sizeof(buffer);
+            if (!read(buffer, n)) {
+                return false;
+            }
+            length -= n;
+        }
+        return true;
+    }
+};
+
+//------------------------------------------------------------------------------
+// Archive
+//------------------------------------------------------------------------------
+
+bool Archive::isArchive(const std::string &path) {
+    return endsWith(path, ".tar") || endsWith(path, ".tar.gz") || endsWith(path, ".tgz") || endsWith(path, ".zip");
+}
+
+Archive::Archive(std::string path) : path(path) {
+    root = path;
+    for (const char* extension : {".tar.gz", ".tgz", ".tar", ".zip"}) {
+        if (endsWith(root, extension)) {
+            root.resize(root.size() - strlen(extension));
+            break;
+        }
+    }
+
+    // As ClangTool makes the source paths absolute
+    if (root.empty() || root[0] != '/') {
+        std::vector<char> cwd(4096);
+        if (!getcwd(cwd.data(), cwd.size())) {
+            Logger::abortError(std::string("Cannot get working directory: ") + strerror(errno));
+        }
+        root = std::string(cwd.data()) + "/" + root;
+    }
+
+    if (endsWith(path, ".zip")) {
+        readZip();
+    } else {
+        readTar();
+    }
+}
+
+const std::map<std::string, std::string> &Archive::getFiles() const {
+    return files;
+}
+
+std::string Archive::findFile(const std::string &suffix) const {
+    std::string found;
+
+    for (auto &it : files) {
+        const std::string &filePath = it.first;
+        if (!endsWith(filePath, suffix) || filePath[filePath.size() - suffix.size() - 1] != '/') {
+            continue;
+        }
+
+        if (!found.empty()) {
+            Logger::abortError("Several members of " + path + " end with " + suffix + ": " + found + ", " + filePath);
+        }
+        found = filePath;
+    }
+
+    return found;
+}
+
+bool Archive::wantsMember(const std::string &memberPath, size_t size) const {
+    if (memberPath.empty() || memberPath[0] == '/' || size > MAX_MEMBER_SIZE) {
+        return false;
+    }
+
+    std::stringstream ss(memberPath);
+    std::string component;
+    while (std::getline(ss, component, '/')) {
+        if (component == "..") {
+            return false;
+        }
+    }
+
+    for (const char* extension : {".c", ".h", ".cc", ".cpp", ".hpp"}) {
+        if (endsWith(memberPath, extension)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Archive::addMember(const std::string &memberPath, std::string contents) {
+    std::string relativePath = memberPath;
+    while (relativePath.compare(0, 2, "./") == 0) {
+        relativePath = relativePath.substr(2);
+    }
+
+    files[root + "/" + relativePath] = std::move(contents);
+}
+
+void Archive::readTar() {
+    GzipReader reader(path);
+    if (!reader.isOpen()) {
+        Logger::abortError("Cannot open archive " + path + ": " + strerror(errno));
+    }
+
+    std::string longName; // From a GNU 'L' or pax 'x' entry, for the next one
+    char header[TAR_BLOCK_SIZE];
+
+    while (reader.read(header, TAR_BLOCK_SIZE)) {
+        // The archive ends with zero blocks
+        if (header[0] == '\0') {
+            return;
+        }
+
+        uint64_t size = readTarNumber(header + 124, 12);
+        uint64_t paddedSize = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+        char type = header[156];
+
+        std::string memberPath = readField(header, 100);
+        if (memcmp(header + 257, "ustar", 5) == 0 && header[345] != '\0') {
+            memberPath = readField(header + 345, 155) + "/" + memberPath;
+        }
+        if (!longName.empty()) {
+            memberPath = longName;
+            longName.clear();
+        }
+
+        if (type == 'L' || type == 'x') {
+            if (size > MAX_MEMBER_SIZE) {
+                Logger::abortError("Malformed archive " + path);
+            }
+
+            std::string data(paddedSize, '\0');
+            if (!reader.read(&data[0], paddedSize)) {
+                Logger::abortError("Truncated archive " + path);
+            }
+            data.resize(size);
+            longName = (type == 'L') ? readField(data.data(), data.size()) : readPaxPath(data);
+            continue;
+        }
+
+        bool isFile = (type == '0' || type == '\0' || type == '7');
+        if (!isFile || !wantsMember(memberPath, size)) {
+            if (!reader.skip(paddedSize)) {
+                Logger::abortError("Truncated archive " + path);
+            }
+            continue;
+        }
+
+        std::string contents(paddedSize, '\0');
+        if (paddedSize > 0 && !reader.read(&contents[0], paddedSize)) {
+            Logger::abortError("Truncated archive " + path);
+        }
+        contents.resize(size);
+        addMember(memberPath, std::move(contents));
+    }
+
+    Logger::abortError("Truncated archive " + path);
+}
+
+// The central directory is at the end, so the zip is read whole first
+void Archive::readZip() {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        Logger::abortError("Cannot open archive " + path + ": " + strerror(errno));
+    }
+    std::string zip((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    // The end of central directory record is followed by a comment of up to 64K
+    const size_t END_SIZE = 22;
+    size_t end = std::string::npos;
+    for (size_t i = zip.size() >= END_SIZE ? zip.size() - END_SIZE + 1 : 0; i-- > 0 && zip.size() - i <= END_SIZE + 0xffff;) {
+        if (readLE32(zip.data() + i) == ZIP_END_OF_CENTRAL_DIR) {
+            end = i;
+            break;
+        }
+    }
+    if (end == std::string::npos) {
+        Logger::abortError("Malformed archive " + path);
+    }
+
+    size_t numEntries = readLE16(zip.data() + end + 10);
+    size_t entry = readLE32(zip.data() + end + 16);
+
+    for (size_t i = 0; i < numEntries; i++) {
+        if (entry + 46 > zip.size() || readLE32(zip.data() + entry) != ZIP_CENTRAL_HEADER) {
+            Logger::abortError("Malformed archive " + path);
+        }
+
+        const char* central = zip.data() + entry;
+        uint16_t flags = readLE16(central + 8);
+        uint16_t method = readLE16(central + 10);
+        uint32_t compressedSize = readLE32(central + 20);
+        uint32_t size = readLE32(central + 24);
+        uint16_t nameLength = readLE16(central + 28);
+        uint32_t localOffset = readLE32(central + 42);
+        size_t nextEntry = entry + 46 + nameLength + readLE16(central + 30) + readLE16(central + 32);
+
+        if (entry + 46 + nameLength > zip.size()) {
+            Logger::abortError("Malformed archive " + path);
+        }
+        std::string memberPath(central + 46, nameLength);
+        entry = nextEntry;
+
+        if (endsWith(memberPath, "/") || !wantsMember(memberPath, size)) {
+            continue;
+        }
+        if (compressedSize == 0xffffffff || size == 0xffffffff || localOffset == 0xffffffff) {
+            Logger::abortError("Zip64 archives are not supported: " + path);
+        }
+        if ((flags & 1) || (method != 0 && method != Z_DEFLATED)) {
+            Logger::abortError("Unsupported zip compression for " + memberPath + " in " + path);
+        }
+
+        if (localOffset + 30 > zip.size() || readLE32(zip.data() + localOffset) != ZIP_LOCAL_HEADER) {
+            Logger::abortError("Malformed archive " + path);
+        }
+        size_t dataOffset = localOffset + 30 + readLE16(zip.data() + localOffset + 26) + readLE16(zip.data() + localOffset + 28);
+        if (dataOffset + compressedSize > zip.size()) {
+            Logger::abortError("Malformed archive " + path);
+        }
+
+        if (method == 0) {
+            addMember(memberPath, zip.substr(dataOffset, size));
+            continue;
+        }
+
+        // Raw deflate, without a zlib header
+        std::string contents(size, '\0');
+        z_stream inflater;
+        memset(&inflater, 0, sizeof(inflater));
+        inflater.next_in = (Bytef*) (zip.data() + dataOffset);
+        inflater.avail_in = compressedSize;
+        inflater.next_out = (Bytef*) &contents[0];
+        inflater.avail_out = size;
+
+        bool inflated = (inflateInit2(&inflater, -MAX_WBITS) == Z_OK);
+        inflated = inflated && (inflate(&inflater, Z_FINISH) == Z_STREAM_END) && (inflater.total_out == size);
+        inflateEnd(&inflater);
+
+        if (!inflated) {
+            Logger::abortError("Corrupt member " + memberPath + " in " + path);
+        }
+        addMember(memberPath, std::move(contents));
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+//------------------------------------------------------------------------------
+// Archive
+//
+// Submission tarball (.tar, .tar.gz, .tgz) or zip, read in one pass without
+// unpacking it. Source members are kept in memory, under the archive path
+// without its extension, e.g. subs/student1.tgz holding src/paster_nbio.c gives
+// /abs/subs/student1/src/paster_nbio.c, and are handed to Clang as virtual
+// files. Everything else is skipped as it is read.
+//
+// Malformed or unsupported archives (zip64, encrypted or unusual compression)
+// abort, like other input errors.
+//------------------------------------------------------------------------------
+
+class Archive {
+    static const size_t MAX_MEMBER_SIZE = 16 * 1024 * 1024;
+
+    const std::string path;
+    std::string root; // Absolute, without the archive extension
+    std::map<std::string, std::string> files;
+
+    void readTar();
+    void readZip();
+
+    // False for members that are skipped, e.g. not a source file or outside
+    // the archive
+    bool wantsMember(const std::string &memberPath, size_t size) const;
+    void addMember(const std::string &memberPath, std::string contents);
+
+public:
+    static bool isArchive(const std::string &path);
+
+    explicit Archive(std::string path);
+
+    // Contents by virtual path
+    const std::map<std::string, std::string> &getFiles() const;
+
+    // Virtual path of the member whose path ends with suffix (a whole path
+    // component at least), "" if there is none. Aborts if several match.
+    std::string findFile(const std::string &suffix) const;
+};
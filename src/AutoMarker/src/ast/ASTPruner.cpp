@@ -19,13 +19,13 @@ ASTPruner::~ASTPruner() {
 bool ASTPruner::isSafeToDelete(CaptedASTNode* root, bool keepChildren) {
     // Cannot be VarStatement and be in interestingVars
     if (VarStatement* varStatement = dyn_cast<VarStatement>(root->getData())) {
-        return (interestingVars.count(varStatement->getDecl()) == 0);
+        return (interestingVars.count(varStatement->getSymbol().id) == 0);
     }
 
     // Cannot reference an interesting var
     if (DeclRefStatement* declRefStatement = dyn_cast<DeclRefStatement>(root->getData())) {
-        if (VarDecl* varDecl = dyn_cast<VarDecl>(declRefStatement->getDecl())) {
-            return (interestingVars.count(varDecl) == 0);
+        if (declRefStatement->isVarRef()) {
+            return (interestingVars.count(declRefStatement->getSymbol().id) == 0);
         }
     }
 
@@ -95,13 +95,13 @@ void ASTPruner::findInterestingVars(CaptedASTNode* root) {
 
         for (std::string reader : varStatement->getReaders()) {
             if (interestingFunctions.count(reader) > 0) {
-                interestingVars.insert(varStatement->getDecl());
+                interestingVars.insert(varStatement->getSymbol().id);
             }
         }
 
         for (std::string writer : varStatement->getWriters()) {
             if (interestingFunctions.count(writer) > 0) {
-                interestingVars.insert(varStatement->getDecl());
+                interestingVars.insert(varStatement->getSymbol().id);
             }
         }
     });
@@ -134,12 +134,11 @@ void ASTPruner::registerVarsAsInteresting(CaptedASTNode* root) {
             return;
         }
 
-        VarDecl* varDecl = dyn_cast<VarDecl>(declRefStatement->getDecl());
-        if (!varDecl) {
+        if (!declRefStatement->isVarRef()) {
             return;
         }
 
-        interestingVars.insert(varDecl);
+        interestingVars.insert(declRefStatement->getSymbol().id);
     });
 }
 
@@ -152,12 +151,11 @@ bool ASTPruner::hasRefToInterestingVars(CaptedASTNode* root) {
             return;
         }
 
-        VarDecl* varDecl = dyn_cast<VarDecl>(declRefStatement->getDecl());
-        if (!varDecl) {
+        if (!declRefStatement->isVarRef()) {
             return;
         }
 
-        numInterestingVars += interestingVars.count(varDecl);
+        numInterestingVars += interestingVars.count(declRefStatement->getSymbol().id);
     });
 
     return (numInterestingVars > 0);
@@ -210,7 +208,7 @@ void ASTPruner::pruneUnusedVarDecl(CaptedASTNode* root) {
         }
 
         // Remove if this variable is not in our "interesting" set
-        bool shouldRemove = (interestingVars.count(varStatement->getDecl()) == 0);
+        bool shouldRemove = (interestingVars.count(varStatement->getSymbol().id) == 0);
         if (shouldRemove) {
             deletedVarStatements.insert(varStatement);
         }
@@ -297,7 +295,7 @@ void ASTPruner::dump() {
 
     cerr << "ASTPruner::interestingVars:" << interestingVars.size() << endl;
     for (auto &var : interestingVars) {
-        cerr << var << ": " << var->getNameAsString() << endl;
+        cerr << "decl:" << var << endl;
     }
     cerr << endl;
 }
@@ -19,7 +19,7 @@ class ASTPruner
         "exit",
     };
 
-    std::set<VarDecl*> interestingVars;
+    std::set<uint64_t> interestingVars; // Symbol ids
 
     void findInterestingVars(CaptedASTNode* root);
     void findAliasedInterestingVars(CaptedASTNode* root);
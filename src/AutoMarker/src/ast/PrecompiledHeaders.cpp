@@ -0,0 +1,280 @@
+#include "PrecompiledHeaders.h"
+#include "Logger.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+
+using namespace clang;
+using namespace clang::tooling;
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+// FNV-1a, since the key has to be the same in every process
+static uint64_t hashBytes(uint64_t hash, const std::string &bytes) {
+    for (unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    // Separates consecutive fields
+    hash ^= 0xff;
+    hash *= 1099511628211ULL;
+    return hash;
+}
+
+// Comments become a space, keeping newlines so that lines still match up
+static std::string stripComments(const std::string &source) {
+    std::string code;
+    code.reserve(source.size());
+
+    size_t i = 0;
+    while (i < source.size()) {
+        char c = source[i];
+        char next = i + 1 < source.size() ? source[i + 1] : '\0';
+
+        if (c == '/' && next == '/') {
+            while (i < source.size() && source[i] != '\n') {
+                i++;
+            }
+            code += ' ';
+        } else if (c == '/' && next == '*') {
+            i += 2;
+            while (i < source.size() && !(source[i] == '*' && i + 1 < source.size() && source[i + 1] == '/')) {
+                if (source[i] == '\n') {
+                    code += '\n';
+                }
+                i++;
+            }
+            i += 2;
+            code += ' ';
+        } else if (c == '"' || c == '\'') {
+            // Literals may hold "//", e.g. a #define'd URL
+            code += c;
+            i++;
+            while (i < source.size() && source[i] != c && source[i] != '\n') {
+                if (source[i] == '\\' && i + 1 < source.size()) {
+                    code += source[i++];
+                }
+                code += source[i++];
+            }
+            if (i < source.size() && source[i] == c) {
+                code += source[i++];
+            }
+        } else {
+            code += c;
+            i++;
+        }
+    }
+
+    return code;
+}
+
+static std::string trim(const std::string &s) {
+    size_t begin = s.find_first_not_of(" \t\r\f\v");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t\r\f\v");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Runs GeneratePCHAction, writing to a set file instead of the one the driver
+// would derive from the header
+class GeneratePCHActionFactory : public FrontendActionFactory {
+    const std::string outputFile;
+
+public:
+    explicit GeneratePCHActionFactory(std::string outputFile) : outputFile(outputFile) {
+        // nop
+    }
+
+    FrontendAction* create() override {
+        return new GeneratePCHAction();
+    }
+
+    bool runInvocation(std::shared_ptr<CompilerInvocation> invocation, FileManager* files, std::shared_ptr<PCHContainerOperations> pchContainerOps, DiagnosticConsumer* diagConsumer) override {
+        invocation->getFrontendOpts().OutputFile = outputFile;
+        return FrontendActionFactory::runInvocation(invocation, files, pchContainerOps, diagConsumer);
+    }
+};
+
+//------------------------------------------------------------------------------
+// PrecompiledHeaders
+//------------------------------------------------------------------------------
+
+PrecompiledHeaders::PrecompiledHeaders(std::string directory)
+    : directory(directory)
+    , owner(getpid()) {
+    if (directory.empty()) {
+        const char* tmpDir = getenv("TMPDIR");
+        std::string path = std::string(tmpDir ? tmpDir : "/tmp") + "/cam-pch-XXXXXX";
+        std::vector<char> pathBuffer(path.begin(), path.end());
+        pathBuffer.push_back('\0');
+
+        if (!mkdtemp(pathBuffer.data())) {
+            Logger::abortError("Cannot create PCH directory " + path + ": " + strerror(errno));
+        }
+        this->directory = pathBuffer.data();
+        ownsDirectory = true;
+    } else if (std::error_code error = llvm::sys::fs::create_directories(directory)) {
+        Logger::abortError("Cannot create PCH directory " + directory + ": " + error.message());
+    }
+
+    // The PCH records the path of the header it was built from
+    llvm::SmallString<256> absolutePath(this->directory);
+    llvm::sys::fs::make_absolute(absolutePath);
+    this->directory = absolutePath.str();
+}
+
+PrecompiledHeaders::~PrecompiledHeaders() {
+    if (!ownsDirectory || getpid() != owner) {
+        return;
+    }
+
+    std::error_code error;
+    std::vector<std::string> entries;
+    for (llvm::sys::fs::directory_iterator it(directory, error), end; it != end && !error; it.increment(error)) {
+        entries.push_back(it->path());
+    }
+    for (const std::string &entry : entries) {
+        llvm::sys::fs::remove(entry);
+    }
+    llvm::sys::fs::remove(directory);
+}
+
+std::string PrecompiledHeaders::getIncludePrefix(const std::string &source, const std::set<std::string> &headers) {
+    std::string prefix;
+    size_t prefixEnd = 0;
+
+    std::stringstream code(stripComments(source));
+    std::string line;
+    while (std::getline(code, line)) {
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        if (line[0] != '#' || line.back() == '\\') {
+            break;
+        }
+
+        std::string directive = trim(line.substr(1));
+        if (directive.compare(0, 7, "include") == 0) {
+            std::string header = trim(directive.substr(7));
+            if (header.size() < 2 || header.front() != '<' || header.back() != '>' || headers.count(header.substr(1, header.size() - 2)) == 0) {
+                break;
+            }
+
+            prefix += "#include " + header + "\n";
+            prefixEnd = prefix.size();
+        } else if (directive.compare(0, 6, "define") == 0 || directive.compare(0, 5, "undef") == 0) {
+            // Feature macros like _GNU_SOURCE and PNG_DEBUG change what the
+            // headers declare
+            prefix += "#" + directive + "\n";
+        } else {
+            break;
+        }
+    }
+
+    return prefix.substr(0, prefixEnd);
+}
+
+std::string PrecompiledHeaders::getPCH(const CompilationDatabase &compilations, const std::string &file, const std::string &source, const std::set<std::string> &headers) {
+    if (headers.empty()) {
+        return "";
+    }
+
+    std::string prefix = getIncludePrefix(source, headers);
+    std::vector<CompileCommand> commands = compilations.getCompileCommands(file);
+    if (prefix.empty() || commands.size() != 1) {
+        return "";
+    }
+
+    // Everything but the tool and the file itself, which the PCH must not
+    // depend on
+    std::vector<std::string> args;
+    for (size_t i = 1; i < commands[0].CommandLine.size(); i++) {
+        const std::string &arg = commands[0].CommandLine[i];
+        if (arg != commands[0].Filename && arg != file) {
+            args.push_back(arg);
+        }
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashBytes(hash, getClangFullVersion());
+    hash = hashBytes(hash, commands[0].Directory);
+    for (const std::string &arg : args) {
+        hash = hashBytes(hash, arg);
+    }
+    hash = hashBytes(hash, prefix);
+
+    std::stringstream key;
+    key << std::hex << hash;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = pchPaths.find(key.str());
+    if (it != pchPaths.end()) {
+        std::shared_future<std::string> pchPath = it->second;
+        lock.unlock();
+        return pchPath.get();
+    }
+
+    // Other threads wait for this one to build it
+    std::promise<std::string> pchPath;
+    pchPaths.insert(std::make_pair(key.str(), pchPath.get_future().share()));
+    lock.unlock();
+
+    std::string path = build(key.str(), prefix, commands[0], args);
+    pchPath.set_value(path);
+    return path;
+}
+
+std::string PrecompiledHeaders::build(const std::string &key, const std::string &prefix, const CompileCommand &command, const std::vector<std::string> &args) {
+    std::string headerPath = directory + "/" + key + ".h";
+    std::string pchPath = directory + "/" + key + ".pch";
+
+    // Built by another process, e.g. an earlier child
+    if (llvm::sys::fs::exists(pchPath)) {
+        return pchPath;
+    }
+
+    // The PCH is invalid once its header is modified, so a header another
+    // process already wrote is never replaced
+    if (!llvm::sys::fs::exists(headerPath)) {
+        std::string tmpPath = headerPath + "." + std::to_string(getpid());
+        {
+            std::ofstream header(tmpPath);
+            header << prefix;
+        }
+        if (link(tmpPath.c_str(), headerPath.c_str()) != 0 && errno != EEXIST) {
+            std::cerr << "Cannot write " << headerPath << ": " << strerror(errno) << std::endl;
+            remove(tmpPath.c_str());
+            return "";
+        }
+        remove(tmpPath.c_str());
+    }
+
+    // GeneratePCHAction writes to a temporary file and renames it into place
+    FixedCompilationDatabase compilations(command.Directory, args);
+    ClangTool tool(compilations, {headerPath});
+    GeneratePCHActionFactory factory(pchPath);
+    if (tool.run(&factory) != 0) {
+        std::cerr << "Cannot precompile headers for " << command.Filename << std::endl;
+        return "";
+    }
+
+    return pchPath;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/types.h>
+#include "clang/Tooling/CompilationDatabase.h"
+
+namespace clang {
+
+//------------------------------------------------------------------------------
+// Precompiled Headers
+//
+// Submissions all start with much the same system headers (libc, png.h,
+// curl/curl.h, pthread.h), which take far longer to parse than the student's
+// own code. The leading #include and #define lines of a file, up to its last
+// #include, are precompiled once and the file is then parsed with -include-pch.
+// Its own #includes are skipped by their include guards.
+//
+// Files only share a PCH when those lines (ignoring comments and whitespace)
+// and their compile commands are the same, so the PCH leaves the preprocessor
+// in the state the file expects. Since students mostly keep the includes of
+// the starter code, a handful of PCHs cover a whole class.
+//
+// Only the headers a marker lists are precompiled, anything else (a local
+// header, a conditional include) ends the prefix.
+//
+// The PCHs are kept in a directory so that forked children, which mark one
+// student each, reuse the ones built by earlier children.
+//------------------------------------------------------------------------------
+
+class PrecompiledHeaders {
+    std::string directory;
+    bool ownsDirectory = false;
+    pid_t owner; // Forked children must not remove the directory
+
+    std::mutex mutex;
+    std::map<std::string, std::shared_future<std::string>> pchPaths; // "" if it couldn't be built
+
+    std::string build(const std::string &key, const std::string &prefix, const tooling::CompileCommand &command, const std::vector<std::string> &args);
+
+public:
+    // Without a directory, one is made under TMPDIR and removed with this
+    explicit PrecompiledHeaders(std::string directory);
+    ~PrecompiledHeaders();
+
+    // Leading #include and #define lines of source, without comments, or "" if
+    // they include anything not in headers
+    static std::string getIncludePrefix(const std::string &source, const std::set<std::string> &headers);
+
+    // PCH to parse file, whose contents are source, with. Built on first use,
+    // or "" if there is none. Safe to call from several threads.
+    std::string getPCH(const tooling::CompilationDatabase &compilations, const std::string &file, const std::string &source, const std::set<std::string> &headers);
+};
+
+} // namespace clang
@@ -1,6 +1,8 @@
 #include "SimpleStatement.h"
+#include <atomic>
 #include <iostream>
 #include <iomanip>
+#include <map>
 
 using namespace clang;
 
@@ -13,3 +15,47 @@ void clang::dumpCaptedASTNode(CaptedASTNode* root) {
 SimpleStatement* clang::cloneData(const SimpleStatement* original) {
     return original->clone();
 }
+
+//------------------------------------------------------------------------------
+// SymbolInfo
+//------------------------------------------------------------------------------
+
+static std::atomic<uint64_t> nextSymbolId(1);
+static thread_local SymbolInfo::DeclIds* declSymbolIds = nullptr;
+
+// Everything is taken from the canonical Decl, like the cost models did when
+// they looked at the Decl directly
+SymbolInfo SymbolInfo::fromDecl(NamedDecl* namedDecl) {
+    NamedDecl* canonicalDecl = cast<NamedDecl>(namedDecl->getCanonicalDecl());
+    SymbolInfo symbol;
+
+    assert(declSymbolIds && "Decls are only mapped through a Solution");
+    auto it = declSymbolIds->find(canonicalDecl);
+    if (it == declSymbolIds->end()) {
+        it = declSymbolIds->insert(std::make_pair(canonicalDecl, newId())).first;
+    }
+    symbol.id = it->second;
+    symbol.name = canonicalDecl->getNameAsString();
+
+    if (VarDecl* varDecl = dyn_cast<VarDecl>(canonicalDecl)) {
+        symbol.kind = SK_VAR;
+        symbol.isLocal = varDecl->isLocalVarDeclOrParm();
+        symbol.type = varDecl->getType().getCanonicalType().getAsString();
+    } else if (FunctionDecl* fnDecl = dyn_cast<FunctionDecl>(canonicalDecl)) {
+        symbol.kind = SK_FUNCTION;
+        symbol.type = fnDecl->getReturnType().getCanonicalType().getAsString();
+        for (ParmVarDecl* paramDecl : fnDecl->parameters()) {
+            symbol.paramTypes.push_back(paramDecl->getType().getCanonicalType().getAsString());
+        }
+    }
+
+    return symbol;
+}
+
+uint64_t SymbolInfo::newId() {
+    return nextSymbolId++;
+}
+
+void SymbolInfo::setDeclIds(DeclIds* declIds) {
+    declSymbolIds = declIds;
+}
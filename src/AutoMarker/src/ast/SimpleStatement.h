@@ -1,6 +1,9 @@
 #pragma once
 
+#include <map>
 #include <set>
+#include <string>
+#include <vector>
 #include "clang/AST/Stmt.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/Expr.h"
@@ -56,6 +59,12 @@ public:
         return className;
     }
 
+    // toString() without anything specific to one Solution, such as symbol
+    // ids, so that equal statements of different solutions have equal labels
+    virtual std::string getLabel() const {
+        return toString();
+    }
+
     StatementType getKind() const {
         return statementType;
     }
@@ -71,17 +80,56 @@ public:
 
 typedef capted::Node<SimpleStatement> CaptedASTNode;
 
+class SolutionCache;
+
 // For debugging
 void dumpCaptedASTNode(CaptedASTNode* root);
 
 // For Capted library
 SimpleStatement* cloneData(const SimpleStatement* original);
 
+//-------------------------------------
+// SymbolInfo
+//
+// What the cost models and markers need to know about the declaration behind a
+// VarStatement or DeclRefStatement, captured while mapping so that a tree can
+// be compared without its ASTContext (see SolutionCache)
+//-------------------------------------
+
+struct SymbolInfo {
+    enum SymbolKind {
+        SK_OTHER,
+        SK_VAR,
+        SK_FUNCTION,
+    };
+
+    uint64_t id = 0; // One per canonical Decl, unique within the process
+    SymbolKind kind = SK_OTHER;
+    std::string name;
+    bool isLocal = false;                // VarDecl::isLocalVarDeclOrParm()
+    std::string type;                    // Canonical type, the return type of functions
+    std::vector<std::string> paramTypes; // Canonical types, functions only
+
+    static SymbolInfo fromDecl(NamedDecl* namedDecl);
+
+    // For symbols that are not backed by a Decl, e.g. restored from a cache
+    static uint64_t newId();
+
+    // Decl to id lookups belong to the Solution being mapped, which may map
+    // more functions long after it is built, so that a Decl address reused by
+    // another translation unit gets a new id. Set per thread, nullptr when
+    // done.
+    typedef std::map<const Decl*, uint64_t> DeclIds;
+    static void setDeclIds(DeclIds* declIds);
+};
+
 //-------------------------------------
 // UselessStatement
 //-------------------------------------
 
 class UselessStatement : public SimpleStatement {
+    friend class SolutionCache;
+
     const std::string origName;
 
 public:
@@ -123,6 +171,8 @@ public:
 //-------------------------------------
 
 class OperatorStatement : public SimpleStatement {
+    friend class SolutionCache;
+
     const std::string origName;
     int opcode;
 
@@ -153,6 +203,8 @@ public:
 //-------------------------------------
 
 class VarStatement : public SimpleStatement {
+    friend class SolutionCache;
+
     enum UseType {
         UNKNOWN,
         READ,
@@ -219,7 +271,7 @@ class VarStatement : public SimpleStatement {
         }
     };
 
-    VarDecl* canonicalDecl;
+    SymbolInfo symbol;
     std::string varName;
     std::set<VarUse> writes;
     std::set<VarUse> reads;
@@ -227,15 +279,23 @@ class VarStatement : public SimpleStatement {
 public:
     VarStatement(VarDecl* varDecl)
         : SimpleStatement("VarStatement", ST_VAR)
-        , canonicalDecl(varDecl->getCanonicalDecl())
-        , varName(canonicalDecl->getNameAsString())
+        , symbol(SymbolInfo::fromDecl(varDecl))
+        , varName(symbol.name)
+        , writes({})
+        , reads({})
+        { }
+
+    VarStatement(const SymbolInfo &symbol)
+        : SimpleStatement("VarStatement", ST_VAR)
+        , symbol(symbol)
+        , varName(symbol.name)
         , writes({})
         , reads({})
         { }
 
     VarStatement(const VarStatement &varStatement)
         : SimpleStatement("VarStatement", ST_VAR)
-        , canonicalDecl(varStatement.canonicalDecl)
+        , symbol(varStatement.symbol)
         , varName(varStatement.varName)
         , writes(varStatement.writes)
         , reads(varStatement.reads)
@@ -247,7 +307,16 @@ public:
 
     virtual std::string toString() const override {
         std::stringstream ss;
-        ss << className << ":" << varName << " decl:" << canonicalDecl;
+        ss << className << ":" << varName << " decl:" << symbol.id << getUsesString();
+        return ss.str();
+    }
+
+    virtual std::string getLabel() const override {
+        return className + ":" + varName + getUsesString();
+    }
+
+    std::string getUsesString() const {
+        std::stringstream ss;
 
         for (const VarUse &use : reads) {
             ss << " " << use.toString();
@@ -260,8 +329,8 @@ public:
         return ss.str();
     }
 
-    VarDecl* getDecl() {
-        return canonicalDecl;
+    const SymbolInfo &getSymbol() const {
+        return symbol;
     }
 
     std::string getName() {
@@ -315,32 +384,44 @@ public:
 
 class DeclRefStatement : public SimpleStatement {
     VarStatement* varStatement;
-    Decl* canonicalDecl;
+    SymbolInfo symbol;
     std::string targetName;
 
 public:
     DeclRefStatement(NamedDecl* namedDeclRef)
         : SimpleStatement("DeclRefStatement", ST_DECL_REF)
         , varStatement(nullptr)
-        , canonicalDecl(namedDeclRef->getCanonicalDecl())
+        , symbol(SymbolInfo::fromDecl(namedDeclRef))
         , targetName(namedDeclRef->getNameAsString())
         { }
 
+    DeclRefStatement(const SymbolInfo &symbol)
+        : SimpleStatement("DeclRefStatement", ST_DECL_REF)
+        , varStatement(nullptr)
+        , symbol(symbol)
+        , targetName(symbol.name)
+        { }
+
     DeclRefStatement(const DeclRefStatement &declRefStatement)
         : SimpleStatement("DeclRefStatement", ST_DECL_REF)
         , varStatement(nullptr)
-        , canonicalDecl(declRefStatement.canonicalDecl)
+        , symbol(declRefStatement.symbol)
         , targetName(declRefStatement.targetName)
         { }
 
-    Decl* getDecl() {
-        return canonicalDecl;
+    // Refers to a variable, as opposed to a function or an enum constant
+    bool isVarRef() const {
+        return symbol.kind == SymbolInfo::SK_VAR;
+    }
+
+    const SymbolInfo &getSymbol() const {
+        return symbol;
     }
 
     void setVarStatement(VarStatement* varStatement) {
-        // Should be called from postCreateTree()
+        // Should be called from postCreateTree() or SolutionCache
         assert(this->varStatement == nullptr || this->varStatement == varStatement);
-        assert(isa<VarDecl>(canonicalDecl));
+        assert(symbol.kind == SymbolInfo::SK_VAR);
         this->varStatement = varStatement;
     }
 
@@ -354,7 +435,25 @@ public:
 
     virtual std::string toString() const override {
         std::stringstream ss;
-        ss << className << ":" << targetName << " decl:" << canonicalDecl;
+        ss << className << ":" << targetName << " decl:" << symbol.id;
+        return ss.str();
+    }
+
+    // The cost models compare references by their symbol and the uses of the
+    // variable they refer to, which pruning may have removed
+    virtual std::string getLabel() const override {
+        std::stringstream ss;
+        ss << className << ":" << targetName << " symbol:" << symbol.name << " kind:" << symbol.kind
+           << " local:" << symbol.isLocal << " type:" << symbol.type;
+
+        for (const std::string &paramType : symbol.paramTypes) {
+            ss << " param:" << paramType;
+        }
+
+        if (varStatement) {
+            ss << " var:" << varStatement->getUsesString();
+        }
+
         return ss.str();
     }
 
@@ -517,25 +616,35 @@ public:
 //-------------------------------------
 
 class FunctionStatement : public SimpleStatement {
-    FunctionDecl* fnDecl;
+    std::string fnName;
+    unsigned numParams;
 
 public:
     FunctionStatement(FunctionDecl* fnDecl)
         : SimpleStatement("FunctionStatement-" + fnDecl->getNameInfo().getAsString(), ST_FUNCTION)
-        , fnDecl(fnDecl)
+        , fnName(fnDecl->getNameInfo().getAsString())
+        , numParams(fnDecl->getNumParams())
+        { }
+
+    FunctionStatement(std::string fnName, unsigned numParams)
+        : SimpleStatement("FunctionStatement-" + fnName, ST_FUNCTION)
+        , fnName(fnName)
+        , numParams(numParams)
         { }
 
     FunctionStatement(const FunctionStatement &fnNode)
         : SimpleStatement("FunctionStatement-" + fnNode.getName(), ST_FUNCTION)
-        , fnDecl(fnNode.fnDecl)
+        , fnName(fnNode.fnName)
+        , numParams(fnNode.numParams)
         { }
 
-    FunctionDecl* getDecl() {
-        return fnDecl;
+    std::string getName() const {
+        return fnName;
     }
 
-    std::string getName() const {
-        return fnDecl->getNameInfo().getAsString();
+    // The first children of the function node are its params
+    unsigned getNumParams() const {
+        return numParams;
     }
 
     static bool classof(const SimpleStatement* node) {
@@ -17,12 +17,52 @@ void gcNodes(std::map<std::string, CaptedASTNode*> map) {
     }
 }
 
+class CallFinder : public RecursiveASTVisitor<CallFinder> {
+    const std::string &fnName;
+
+public:
+    bool found = false;
+
+    explicit CallFinder(const std::string &fnName) : fnName(fnName) {
+        // nop
+    }
+
+    bool VisitCallExpr(CallExpr* callExpr) {
+        const FunctionDecl* callee = callExpr->getDirectCallee();
+        if (callee && callee->getQualifiedNameAsString() == fnName) {
+            found = true;
+        }
+        return !found;
+    }
+};
+
 //------------------------------------------------------------------------------
 // Solution
 //------------------------------------------------------------------------------
 
-Solution::Solution(TranslationUnitDecl* translationUnitDecl) : astContext(translationUnitDecl->getASTContext()) {
+Solution::Solution(TranslationUnitDecl* translationUnitDecl, const std::set<std::string>* neededFunctions) {
     this->TraverseDecl(translationUnitDecl);
+
+    // Named after the file that defines main(), as included by the compiler
+    SourceManager &srcManager = translationUnitDecl->getASTContext().getSourceManager();
+    auto mainIt = unmappedFunctions.find("main");
+    if (mainIt != unmappedFunctions.end()) {
+        fileName = srcManager.getFilename(mainIt->second->getLocStart()).str();
+    } else {
+        fileName = srcManager.getFileEntryForID(srcManager.getMainFileID())->getName().str();
+    }
+
+    std::set<std::string> fnNames = neededFunctions ? *neededFunctions : getFunctionNames();
+    for (const std::string &fnName : fnNames) {
+        getFunction(fnName);
+    }
+}
+
+Solution::Solution(std::string fileName, std::map<std::string, CaptedASTNode*> functions, bool pruned)
+    : fileName(fileName)
+    , functions(functions)
+    , pruned(pruned) {
+    // nop
 }
 
 Solution::~Solution() {
@@ -33,19 +73,30 @@ bool Solution::VisitFunctionDecl(FunctionDecl* fnDecl) {
     if (fnDecl->isThisDeclarationADefinition()) {
         std::string fnName = fnDecl->getNameInfo().getAsString();
         assert(fnDecl->isMain() == (fnName == "main"));
-        assert(functions.find(fnName) == functions.end());
+        assert(unmappedFunctions.find(fnName) == unmappedFunctions.end());
+
+        // Mapped once it is needed
+        unmappedFunctions.insert(std::make_pair(fnName, fnDecl));
+    }
 
-        ASTMapper mapper(fnDecl);
-        CaptedASTNode* root = mapper.getRoot();
+    return true;
+}
 
-        // Since ASTMapper is constructed recursively, we can't call this function inside it
-        postCreateTree(root);
+CaptedASTNode* Solution::mapFunction(FunctionDecl* fnDecl) {
+    SymbolInfo::setDeclIds(&declIds);
+    ASTMapper mapper(fnDecl);
+    CaptedASTNode* root = mapper.getRoot();
 
-        // Finally attach this function to this solution
-        functions.insert(std::make_pair(fnName, root));
+    // Since ASTMapper is constructed recursively, we can't call this function inside it
+    postCreateTree(root);
+    SymbolInfo::setDeclIds(nullptr);
+
+    if (pruned) {
+        ASTPruner astPruner(prunedKeyFns);
+        astPruner.prune(root);
     }
 
-    return true;
+    return root;
 }
 
 std::map<std::string, CaptedASTNode*>::const_iterator Solution::begin() const {
@@ -57,25 +108,68 @@ std::map<std::string, CaptedASTNode*>::const_iterator Solution::end() const {
 }
 
 std::string Solution::getFileName() {
-    SourceManager &srcManager = astContext.getSourceManager();
-    FunctionStatement* main = cast<FunctionStatement>(getFunction("main")->getData());
-    return srcManager.getFilename(main->getDecl()->getLocStart()).str();
+    return fileName;
 }
 
 CaptedASTNode* Solution::getFunction(std::string fnName) {
-    return functions[fnName];
+    auto it = functions.find(fnName);
+    if (it != functions.end()) {
+        return it->second;
+    }
+
+    auto declIt = unmappedFunctions.find(fnName);
+    if (declIt == unmappedFunctions.end()) {
+        return nullptr;
+    }
+
+    CaptedASTNode* root = mapFunction(declIt->second);
+    unmappedFunctions.erase(declIt);
+
+    // Finally attach this function to this solution
+    functions.insert(std::make_pair(fnName, root));
+    return root;
 }
 
-std::set<std::string> Solution::getFunctionNames() {
+std::set<std::string> Solution::getFunctionNames() const {
     std::set<std::string> names;
 
     for (auto &it : functions) {
         names.insert(it.first);
     }
+    for (auto &it : unmappedFunctions) {
+        names.insert(it.first);
+    }
 
     return names;
 }
 
+bool Solution::hasUnmappedFunctions() const {
+    return !unmappedFunctions.empty();
+}
+
+std::set<std::string> Solution::getCallersOf(const std::string &fnName) const {
+    std::set<std::string> callers;
+
+    for (auto &it : functions) {
+        it.second->dfs([&](CaptedASTNode* currentNode, int depth) -> void {
+            CallStatement* callStatement = dyn_cast<CallStatement>(currentNode->getData());
+            if (callStatement && callStatement->getTargetFn() == fnName) {
+                callers.insert(it.first);
+            }
+        });
+    }
+
+    for (auto &it : unmappedFunctions) {
+        CallFinder callFinder(fnName);
+        callFinder.TraverseDecl(it.second);
+        if (callFinder.found) {
+            callers.insert(it.first);
+        }
+    }
+
+    return callers;
+}
+
 //------------------------------------------------------------------------------
 // Pruning
 //
@@ -95,6 +189,13 @@ void Solution::pruneFunctions(const std::set<std::string> &keyFns) {
         ASTPruner astPruner(keyFns);
         astPruner.prune(root);
     }
+
+    pruned = true;
+    prunedKeyFns = keyFns;
+}
+
+bool Solution::isPruned() const {
+    return pruned;
 }
 
 //------------------------------------------------------------------------------
@@ -115,7 +216,8 @@ void verifyReferenceSolutions(const std::vector<Solution*> &referenceSols) {
     }
 }
 
-void replaceParamRefWithArgExpr(std::map<ParmVarDecl*, CaptedASTNode*> &paramToCallerArgExpr, CaptedASTNode* root) {
+// Params are keyed by symbol id
+void replaceParamRefWithArgExpr(std::map<uint64_t, CaptedASTNode*> &paramToCallerArgExpr, CaptedASTNode* root) {
     // Make a copy since replaceParamRefWithArgExpr() will modify the container
     // This is also why we can't use CaptedASTNode::dfs()
     std::list<CaptedASTNode*> childrenCopy = root->getChildren();
@@ -123,8 +225,9 @@ void replaceParamRefWithArgExpr(std::map<ParmVarDecl*, CaptedASTNode*> &paramToC
     if (DeclRefStatement* declRefStatement = dyn_cast<DeclRefStatement>(root->getData())) {
         assert(childrenCopy.size() == 0); // DeclRefStatement should not have any children
 
-        if (ParmVarDecl* paramDecl = dyn_cast<ParmVarDecl>(declRefStatement->getDecl())) {
-            CaptedASTNode* origExpr = paramToCallerArgExpr[paramDecl];
+        auto it = paramToCallerArgExpr.find(declRefStatement->getSymbol().id);
+        if (it != paramToCallerArgExpr.end()) {
+            CaptedASTNode* origExpr = it->second;
             CaptedASTNode* clonedExpr = origExpr->clone();
 
             root->getParent()->replaceChild(root, clonedExpr);
@@ -140,7 +243,7 @@ void replaceFunctionCall(CaptedASTNode* callSite, CaptedASTNode* functionRoot) {
     CaptedASTNode* clonedRetNode = nullptr;
     CaptedASTNode* clonedFnNode = functionRoot->clone();
     postCreateTree(clonedFnNode);
-    const int numParams = cast<FunctionStatement>(clonedFnNode->getData())->getDecl()->getNumParams();
+    const int numParams = cast<FunctionStatement>(clonedFnNode->getData())->getNumParams();
 
     // Find return statement
     clonedFnNode->dfs([&](CaptedASTNode* currentNode, int depth) -> void {
@@ -160,15 +263,15 @@ void replaceFunctionCall(CaptedASTNode* callSite, CaptedASTNode* functionRoot) {
 
     // Replace function args with parameters
     {
-        std::map<ParmVarDecl*, CaptedASTNode*> paramToCallerArgExpr;
+        std::map<uint64_t, CaptedASTNode*> paramToCallerArgExpr;
         std::list<CaptedASTNode*>::iterator argIter = callSite->getChildren().begin();
         std::list<CaptedASTNode*>::iterator paramIter = clonedFnNode->getChildren().begin();
 
         for (int i = 0; i < numParams; i++, argIter++, paramIter++) {
             CaptedASTNode* argExprNode = *argIter;
             CaptedASTNode* paramNode = *paramIter;
-            ParmVarDecl* param = cast<ParmVarDecl>(cast<VarStatement>(paramNode->getData())->getDecl());
-            paramToCallerArgExpr.insert(std::make_pair(param, argExprNode));
+            const SymbolInfo &param = cast<VarStatement>(paramNode->getData())->getSymbol();
+            paramToCallerArgExpr.insert(std::make_pair(param.id, argExprNode));
         }
 
         replaceParamRefWithArgExpr(paramToCallerArgExpr, clonedFnNode);
@@ -219,10 +322,10 @@ void Solution::inlineUnexpectedStudentFunctions(const std::vector<Solution*> &re
     // Maps function name to dest fn
     std::map<std::string, CaptedASTNode*> fnsToInline;
 
-    {
-        // All solutions have same functions
-        std::set<std::string> solFnNames = referenceSols[0]->getFunctionNames();
+    // All solutions have same functions
+    std::set<std::string> solFnNames = referenceSols[0]->getFunctionNames();
 
+    {
         // Use iter instead of FOR loop because we are potentially removing while iterating
         // (i.e. ConcurrentModificationException)
         auto fnIter = functions.begin();
@@ -256,9 +359,17 @@ void Solution::inlineUnexpectedStudentFunctions(const std::vector<Solution*> &re
                     return;
                 }
 
-                auto it = fnsToInline.find(callStatement->getTargetFn());
+                std::string targetFn = callStatement->getTargetFn();
+                auto it = fnsToInline.find(targetFn);
                 if (it == fnsToInline.end()) {
-                    return;
+                    // Student functions that were not needed up front
+                    auto declIt = unmappedFunctions.find(targetFn);
+                    if (declIt == unmappedFunctions.end() || solFnNames.count(targetFn) != 0) {
+                        return;
+                    }
+
+                    it = fnsToInline.insert(std::make_pair(targetFn, mapFunction(declIt->second))).first;
+                    unmappedFunctions.erase(declIt);
                 }
 
                 callSitesToInline.insert(std::make_pair(currentNode, it->second));
@@ -12,23 +12,46 @@ namespace clang {
 class Solution : public RecursiveASTVisitor<Solution> {
     static const int MAX_INLINE_EXPANSIONS = 10;
 
-    ASTContext &astContext;
+    std::string fileName;
     std::map<std::string, CaptedASTNode*> functions;
+    std::map<std::string, FunctionDecl*> unmappedFunctions; // Definitions not mapped yet
+    SymbolInfo::DeclIds declIds;
+
+    bool pruned = false;
+    std::set<std::string> prunedKeyFns; // Functions mapped after pruning are pruned too
+
+    CaptedASTNode* mapFunction(FunctionDecl* fnDecl);
 
 public:
-    Solution(TranslationUnitDecl* translationUnitDecl);
+    // Every function definition is mapped, unless neededFunctions is given, in
+    // which case any other function is mapped once getFunction() or the
+    // inliner asks for it
+    Solution(TranslationUnitDecl* translationUnitDecl, const std::set<std::string>* neededFunctions = nullptr);
+
+    // Takes ownership of the trees, e.g. restored by SolutionCache
+    Solution(std::string fileName, std::map<std::string, CaptedASTNode*> functions, bool pruned);
+
     virtual ~Solution();
     virtual bool VisitFunctionDecl(FunctionDecl* funcDecl);
 
+    // Only the functions mapped so far
     std::map<std::string, CaptedASTNode*>::const_iterator begin() const;
     std::map<std::string, CaptedASTNode*>::const_iterator end() const;
 
     void pruneFunctions(const std::set<std::string> &keyFns);
+    bool isPruned() const;
     void inlineUnexpectedStudentFunctions(const std::vector<Solution*> &referenceSols);
 
     std::string getFileName();
-    CaptedASTNode* getFunction(std::string name);
-    std::set<std::string> getFunctionNames();
+    CaptedASTNode* getFunction(std::string name); // nullptr if it isn't defined
+    std::set<std::string> getFunctionNames() const;
+
+    // Functions with a call to fnName, without mapping the ones that don't
+    std::set<std::string> getCallersOf(const std::string &fnName) const;
+
+    // Whether this still needs its ASTUnit. Mapped trees hold no Clang
+    // pointers, so the ASTUnit can be freed once every function is mapped.
+    bool hasUnmappedFunctions() const;
 };
 
 }
@@ -0,0 +1,520 @@
+#include "SolutionCache.h"
+#include "SimpleStatement.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+
+#include "clang/Basic/Version.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang;
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+// FNV-1a, since the key has to be the same in every build of the same version
+static uint64_t hashBytes(uint64_t hash, const std::string &bytes) {
+    for (unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    // Separates consecutive fields
+    hash ^= 0xff;
+    hash *= 1099511628211ULL;
+    return hash;
+}
+
+// Where a quoted #include is looked for after the includer's directory
+static std::vector<std::string> getQuoteIncludeDirs(const std::vector<tooling::CompileCommand> &compileCommands) {
+    std::vector<std::string> includeDirs;
+
+    for (const tooling::CompileCommand &command : compileCommands) {
+        const std::vector<std::string> &args = command.CommandLine;
+        for (size_t i = 0; i < args.size(); i++) {
+            llvm::StringRef arg(args[i]);
+            std::string dir;
+
+            for (llvm::StringRef flag : {"-iquote", "-I"}) {
+                if (arg == flag && i + 1 < args.size()) {
+                    dir = args[++i];
+                    break;
+                } else if (arg.startswith(flag) && arg.size() > flag.size()) {
+                    dir = arg.substr(flag.size()).str();
+                    break;
+                }
+            }
+            if (dir.empty()) {
+                continue;
+            }
+
+            llvm::SmallString<256> path(dir);
+            if (llvm::sys::path::is_relative(path)) {
+                path = command.Directory;
+                llvm::sys::path::append(path, dir);
+            }
+            includeDirs.push_back(path.str());
+        }
+    }
+
+    return includeDirs;
+}
+
+// Adds the path and contents of every header reached through #include "..."
+// lines, conditional or not, to hash. A header that isn't found is hashed by
+// name, so that the key changes once it appears.
+static uint64_t hashLocalIncludes(uint64_t hash, const std::string &fileName, llvm::StringRef contents, const std::vector<std::string> &includeDirs, std::set<std::string> &visited) {
+    llvm::SmallVector<llvm::StringRef, 64> lines;
+    contents.split(lines, '\n');
+
+    for (llvm::StringRef line : lines) {
+        line = line.ltrim();
+        if (!line.consume_front("#")) {
+            continue;
+        }
+        line = line.ltrim();
+        if (!line.consume_front("include")) {
+            continue;
+        }
+        line = line.ltrim();
+        if (!line.consume_front("\"")) {
+            continue;
+        }
+        std::string header = line.substr(0, line.find('"')).str();
+
+        std::vector<std::string> candidates = {llvm::sys::path::parent_path(fileName).str()};
+        candidates.insert(candidates.end(), includeDirs.begin(), includeDirs.end());
+
+        std::string headerPath;
+        for (const std::string &dir : candidates) {
+            llvm::SmallString<256> path(dir);
+            llvm::sys::path::append(path, header);
+            if (llvm::sys::fs::is_regular_file(path)) {
+                headerPath = path.str();
+                break;
+            }
+        }
+
+        if (headerPath.empty()) {
+            hash = hashBytes(hash, "missing:" + header);
+            continue;
+        }
+        if (!visited.insert(headerPath).second) {
+            continue;
+        }
+
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> headerContents = llvm::MemoryBuffer::getFile(headerPath);
+        if (!headerContents) {
+            hash = hashBytes(hash, "unreadable:" + headerPath);
+            continue;
+        }
+
+        hash = hashBytes(hash, headerPath);
+        hash = hashBytes(hash, (*headerContents)->getBuffer().str());
+        hash = hashLocalIncludes(hash, headerPath, (*headerContents)->getBuffer(), includeDirs, visited);
+    }
+
+    return hash;
+}
+
+// Whether count more fields, each of at least one byte, can still be in is.
+// Guards the allocations sized by an entry, which may be truncated or corrupt.
+static bool fitsInStream(std::istream &is, size_t count) {
+    std::streampos pos = is.tellg();
+    is.seekg(0, std::ios::end);
+    std::streampos end = is.tellg();
+    is.seekg(pos);
+
+    return pos != std::streampos(-1) && end != std::streampos(-1) && count <= (size_t) (end - pos);
+}
+
+//------------------------------------------------------------------------------
+// SolutionCache
+//------------------------------------------------------------------------------
+
+SolutionCache::SolutionCache(std::string directory) : directory(directory) {
+    if (std::error_code error = llvm::sys::fs::create_directories(directory)) {
+        std::cerr << "Cannot create solution cache " << directory << ": " << error.message() << std::endl;
+    }
+}
+
+std::string SolutionCache::makeKey(const std::string &fileName, const std::vector<tooling::CompileCommand> &compileCommands, const std::map<std::string, std::vector<float>> &keyFns) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> contents = llvm::MemoryBuffer::getFile(fileName);
+    if (!contents) {
+        return "";
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashBytes(hash, std::to_string(CACHE_VERSION));
+    hash = hashBytes(hash, getClangFullVersion());
+    hash = hashBytes(hash, fileName);
+    hash = hashBytes(hash, (*contents)->getBuffer().str());
+
+    for (const tooling::CompileCommand &command : compileCommands) {
+        hash = hashBytes(hash, command.Directory);
+        for (const std::string &arg : command.CommandLine) {
+            hash = hashBytes(hash, arg);
+        }
+    }
+
+    std::set<std::string> visited;
+    hash = hashLocalIncludes(hash, fileName, (*contents)->getBuffer(), getQuoteIncludeDirs(compileCommands), visited);
+
+    for (auto &it : keyFns) {
+        hash = hashBytes(hash, it.first);
+        for (float cost : it.second) {
+            hash = hashBytes(hash, std::to_string(cost));
+        }
+    }
+
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return ss.str();
+}
+
+std::string SolutionCache::getEntryPath(const std::string &key) const {
+    return directory + "/" + key + ".sol";
+}
+
+Solution* SolutionCache::load(const std::string &key) {
+    // Read whole so that fitsInStream() is cheap
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> entry = llvm::MemoryBuffer::getFile(getEntryPath(key));
+    std::istringstream is(entry ? (*entry)->getBuffer().str() : "");
+    std::string magic;
+    int version = 0;
+    std::string fileName;
+    int numFunctions = 0;
+
+    if (!entry || !(is >> magic >> version) || magic != "CAMSOL" || version != CACHE_VERSION || !readString(is, fileName) || !(is >> numFunctions) || numFunctions < 0 || !fitsInStream(is, numFunctions)) {
+        misses++;
+        return nullptr;
+    }
+
+    // Globals are shared between the functions of a solution
+    std::map<uint64_t, uint64_t> symbolIds;
+    std::map<std::string, CaptedASTNode*> functions;
+    for (int i = 0; i < numFunctions; i++) {
+        std::string fnName;
+        CaptedASTNode* root = readString(is, fnName) ? readTree(is, symbolIds) : nullptr;
+
+        if (!root) {
+            for (auto &it : functions) {
+                delete it.second;
+            }
+            misses++;
+            return nullptr;
+        }
+
+        functions.insert(std::make_pair(fnName, root));
+    }
+
+    hits++;
+    return new Solution(fileName, functions, true);
+}
+
+void SolutionCache::store(const std::string &key, Solution* solution) {
+    assert(solution->isPruned());
+
+    // Written aside and renamed into place, since several batch runs can share
+    // one cache
+    std::string path = getEntryPath(key);
+    std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+
+    {
+        std::ofstream os(tmpPath, std::ios::binary);
+        os << "CAMSOL " << CACHE_VERSION;
+        writeString(os, solution->getFileName());
+        os << " " << std::distance(solution->begin(), solution->end());
+
+        for (auto &it : *solution) {
+            writeString(os, it.first);
+            writeTree(os, it.second);
+        }
+        os << "\n";
+
+        if (!os) {
+            std::cerr << "Cannot write solution cache entry " << tmpPath << std::endl;
+            remove(tmpPath.c_str());
+            return;
+        }
+    }
+
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot write solution cache entry " << path << std::endl;
+        remove(tmpPath.c_str());
+    }
+}
+
+long SolutionCache::getHits() const {
+    return hits;
+}
+
+long SolutionCache::getMisses() const {
+    return misses;
+}
+
+//------------------------------------------------------------------------------
+// Format
+//
+// Whitespace separated fields, strings as <length>:<bytes>. A tree is written
+// in preorder, each node as its statement type, the fields of that type and
+// its number of children. A DeclRefStatement refers to its VarStatement by its
+// preorder position among the VarStatements of the function.
+//------------------------------------------------------------------------------
+
+void SolutionCache::writeString(std::ostream &os, const std::string &s) {
+    os << " " << s.size() << ":" << s;
+}
+
+bool SolutionCache::readString(std::istream &is, std::string &s) {
+    size_t length;
+    if (!(is >> length) || is.get() != ':' || !fitsInStream(is, length)) {
+        return false;
+    }
+
+    s.resize(length);
+    return (bool) is.read(&s[0], length);
+}
+
+void SolutionCache::writeSymbol(std::ostream &os, const SymbolInfo &symbol) {
+    os << " " << symbol.id << " " << symbol.kind << " " << symbol.isLocal;
+    writeString(os, symbol.name);
+    writeString(os, symbol.type);
+
+    os << " " << symbol.paramTypes.size();
+    for (const std::string &paramType : symbol.paramTypes) {
+        writeString(os, paramType);
+    }
+}
+
+// Ids are only unique within a process, so every restored solution gets new
+// ones. symbolIds maps the stored ids to them.
+bool SolutionCache::readSymbol(std::istream &is, std::map<uint64_t, uint64_t> &symbolIds, SymbolInfo &symbol) {
+    uint64_t storedId;
+    int kind;
+    size_t numParams;
+
+    if (!(is >> storedId >> kind >> symbol.isLocal) || !readString(is, symbol.name) || !readString(is, symbol.type) || !(is >> numParams) || !fitsInStream(is, numParams)) {
+        return false;
+    }
+
+    symbol.paramTypes.resize(numParams);
+    for (std::string &paramType : symbol.paramTypes) {
+        if (!readString(is, paramType)) {
+            return false;
+        }
+    }
+
+    auto it = symbolIds.find(storedId);
+    if (it == symbolIds.end()) {
+        it = symbolIds.insert(std::make_pair(storedId, SymbolInfo::newId())).first;
+    }
+    symbol.id = it->second;
+    symbol.kind = (SymbolInfo::SymbolKind) kind;
+
+    return true;
+}
+
+void SolutionCache::writeTree(std::ostream &os, CaptedASTNode* root) {
+    std::map<VarStatement*, int> varIndices;
+    root->dfs([&](CaptedASTNode* currentNode, int depth) -> void {
+        if (VarStatement* varStatement = dyn_cast<VarStatement>(currentNode->getData())) {
+            int index = varIndices.size();
+            varIndices.insert(std::make_pair(varStatement, index));
+        }
+    });
+
+    std::function<void(CaptedASTNode*)> writeNode = [&](CaptedASTNode* node) -> void {
+        SimpleStatement* statement = node->getData();
+        os << " " << statement->getKind();
+
+        if (UselessStatement* useless = dyn_cast<UselessStatement>(statement)) {
+            writeString(os, useless->origName);
+        } else if (OperatorStatement* op = dyn_cast<OperatorStatement>(statement)) {
+            writeString(os, op->origName);
+            os << " " << op->opcode;
+        } else if (VarStatement* var = dyn_cast<VarStatement>(statement)) {
+            writeSymbol(os, var->symbol);
+
+            os << " " << var->reads.size();
+            for (auto &use : var->reads) {
+                writeString(os, use.ownerFn);
+                writeString(os, use.userFn);
+                os << " " << use.operand;
+            }
+
+            os << " " << var->writes.size();
+            for (auto &use : var->writes) {
+                writeString(os, use.ownerFn);
+                writeString(os, use.userFn);
+            }
+        } else if (DeclRefStatement* declRef = dyn_cast<DeclRefStatement>(statement)) {
+            // Pruning can remove the VarStatement of a reference
+            auto it = varIndices.find(declRef->getVarStatement());
+            writeSymbol(os, declRef->getSymbol());
+            os << " " << (it == varIndices.end() ? -1 : it->second);
+        } else if (CallStatement* call = dyn_cast<CallStatement>(statement)) {
+            writeString(os, call->getTargetFn());
+        } else if (FunctionStatement* fn = dyn_cast<FunctionStatement>(statement)) {
+            writeString(os, fn->getName());
+            os << " " << fn->getNumParams();
+        } else if (statement->getKind() == SimpleStatement::ST_OTHER) {
+            writeString(os, statement->toString());
+        }
+
+        os << " " << node->getNumChildren();
+        for (CaptedASTNode* child : node->getChildren()) {
+            writeNode(child);
+        }
+    };
+
+    writeNode(root);
+}
+
+CaptedASTNode* SolutionCache::readTree(std::istream &is, std::map<uint64_t, uint64_t> &symbolIds) {
+    std::vector<VarStatement*> vars;
+    std::vector<std::pair<DeclRefStatement*, int>> varRefs;
+
+    CaptedASTNode* root = readNode(is, symbolIds, vars, varRefs);
+    if (!root) {
+        return nullptr;
+    }
+
+    for (auto &varRef : varRefs) {
+        if (varRef.second >= (int) vars.size()) {
+            delete root;
+            return nullptr;
+        }
+        if (varRef.second >= 0) {
+            varRef.first->setVarStatement(vars[varRef.second]);
+        }
+    }
+
+    return root;
+}
+
+CaptedASTNode* SolutionCache::readNode(std::istream &is, std::map<uint64_t, uint64_t> &symbolIds, std::vector<VarStatement*> &vars, std::vector<std::pair<DeclRefStatement*, int>> &varRefs) {
+    SimpleStatement* statement = readStatement(is, symbolIds, vars, varRefs);
+    int numChildren;
+    if (!statement) {
+        return nullptr;
+    }
+
+    CaptedASTNode* node = new CaptedASTNode(statement);
+    if (!(is >> numChildren) || numChildren < 0) {
+        delete node;
+        return nullptr;
+    }
+
+    for (int i = 0; i < numChildren; i++) {
+        CaptedASTNode* child = readNode(is, symbolIds, vars, varRefs);
+        if (!child) {
+            delete node;
+            return nullptr;
+        }
+        node->addChild(child);
+    }
+
+    return node;
+}
+
+SimpleStatement* SolutionCache::readStatement(std::istream &is, std::map<uint64_t, uint64_t> &symbolIds, std::vector<VarStatement*> &vars, std::vector<std::pair<DeclRefStatement*, int>> &varRefs) {
+    int kind;
+    if (!(is >> kind)) {
+        return nullptr;
+    }
+
+    std::string s;
+    switch (kind) {
+        case SimpleStatement::ST_OTHER:
+            return readString(is, s) ? new SimpleStatement(s) : nullptr;
+
+        case SimpleStatement::ST_USELESS:
+            return readString(is, s) ? new UselessStatement(s) : nullptr;
+
+        case SimpleStatement::ST_RETURN:     return new ReturnStatement();
+        case SimpleStatement::ST_ASSN:       return new AssnStatement();
+        case SimpleStatement::ST_IF:         return new IfStatement();
+        case SimpleStatement::ST_CONDITION:  return new ConditionStatement();
+        case SimpleStatement::ST_BLOCK:      return new BlockStatement();
+
+        case SimpleStatement::ST_LOOP_FOR:
+        case SimpleStatement::ST_LOOP_WHILE:
+        case SimpleStatement::ST_LOOP_DO:
+            return new LoopStatement((SimpleStatement::StatementType) kind);
+
+        case SimpleStatement::ST_OPERATOR: {
+            int opcode;
+            return (readString(is, s) && is >> opcode) ? new OperatorStatement(s, opcode) : nullptr;
+        }
+
+        case SimpleStatement::ST_VAR: {
+            SymbolInfo symbol;
+            size_t numReads;
+            if (!readSymbol(is, symbolIds, symbol) || !(is >> numReads) || !fitsInStream(is, numReads)) {
+                return nullptr;
+            }
+
+            VarStatement* var = new VarStatement(symbol);
+            std::string ownerFn;
+            std::string userFn;
+            int operand;
+            size_t numWrites;
+            bool ok = true;
+
+            for (size_t i = 0; ok && i < numReads; i++) {
+                ok = readString(is, ownerFn) && readString(is, userFn) && (is >> operand);
+                if (ok) {
+                    var->registerRead(ownerFn, userFn, operand);
+                }
+            }
+
+            ok = ok && (is >> numWrites) && fitsInStream(is, numWrites);
+            for (size_t i = 0; ok && i < numWrites; i++) {
+                ok = readString(is, ownerFn) && readString(is, userFn);
+                if (ok) {
+                    var->registerWrite(ownerFn, userFn);
+                }
+            }
+
+            if (!ok) {
+                delete var;
+                return nullptr;
+            }
+
+            vars.push_back(var);
+            return var;
+        }
+
+        case SimpleStatement::ST_DECL_REF: {
+            SymbolInfo symbol;
+            int varIndex;
+            if (!readSymbol(is, symbolIds, symbol) || !(is >> varIndex)) {
+                return nullptr;
+            }
+
+            DeclRefStatement* declRef = new DeclRefStatement(symbol);
+            varRefs.push_back(std::make_pair(declRef, varIndex));
+            return declRef;
+        }
+
+        case SimpleStatement::ST_CALL:
+            return readString(is, s) ? new CallStatement(s) : nullptr;
+
+        case SimpleStatement::ST_FUNCTION: {
+            unsigned numParams;
+            return (readString(is, s) && (is >> numParams)) ? new FunctionStatement(s, numParams) : nullptr;
+        }
+
+        default:
+            return nullptr;
+    }
+}
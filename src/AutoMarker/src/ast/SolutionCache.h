@@ -0,0 +1,73 @@
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "Solution.h"
+#include "clang/Tooling/CompilationDatabase.h"
+
+namespace clang {
+
+//------------------------------------------------------------------------------
+// Solution Cache
+//
+// Directory of pruned Solutions, so that warm runs skip Clang entirely for
+// reference solutions, which rarely change during a term.
+//
+// An entry holds the function trees with everything the cost models and
+// markers look at (statement kinds, labels, call targets, SymbolInfo and the
+// reader/writer sets of each VarStatement) but no Decl. Restored solutions can
+// only be compared, not inlined into or pruned again.
+//
+// Entries are keyed by the file name and contents, the contents of the local
+// headers it includes, the compile command, the tool and Clang versions and the
+// marker's key function table, which decides what pruning keeps. Local headers
+// are found without preprocessing, by following #include "..." lines through
+// the includer's directory, -iquote and -I. Headers included through a macro,
+// or with <...> from a -I directory, are not part of the key.
+//
+// Entries are read defensively, since the directory outlives the runs that
+// wrote it; a truncated or corrupt entry is a miss.
+//------------------------------------------------------------------------------
+
+class SolutionCache {
+    // Bump whenever the format, ASTMapper, postCreateTree or ASTPruner change
+    // what ends up in a pruned tree
+    static const int CACHE_VERSION = 2;
+
+    const std::string directory;
+
+    long hits = 0;
+    long misses = 0;
+
+    std::string getEntryPath(const std::string &key) const;
+
+    static void writeString(std::ostream &os, const std::string &s);
+    static bool readString(std::istream &is, std::string &s);
+    static void writeSymbol(std::ostream &os, const SymbolInfo &symbol);
+    static bool readSymbol(std::istream &is, std::map<uint64_t, uint64_t> &symbolIds, SymbolInfo &symbol);
+
+    static void writeTree(std::ostream &os, CaptedASTNode* root);
+    static CaptedASTNode* readTree(std::istream &is, std::map<uint64_t, uint64_t> &symbolIds);
+    static CaptedASTNode* readNode(std::istream &is, std::map<uint64_t, uint64_t> &symbolIds, std::vector<VarStatement*> &vars, std::vector<std::pair<DeclRefStatement*, int>> &varRefs);
+    static SimpleStatement* readStatement(std::istream &is, std::map<uint64_t, uint64_t> &symbolIds, std::vector<VarStatement*> &vars, std::vector<std::pair<DeclRefStatement*, int>> &varRefs);
+
+public:
+    // The directory is created if it doesn't exist
+    explicit SolutionCache(std::string directory);
+
+    static std::string makeKey(const std::string &fileName, const std::vector<tooling::CompileCommand> &compileCommands, const std::map<std::string, std::vector<float>> &keyFns);
+
+    // nullptr on a miss, including unreadable or stale entries
+    Solution* load(const std::string &key);
+
+    // The solution must be pruned. Errors are only reported, the cache is an
+    // optimization.
+    void store(const std::string &key, Solution* solution);
+
+    long getHits() const;
+    long getMisses() const;
+};
+
+} // namespace clang
@@ -139,18 +139,18 @@ void registerReads(CaptedASTNode* root, std::string ownerFn) {
 void clang::postCreateTree(CaptedASTNode* root) {
     FunctionStatement* fnNode = cast<FunctionStatement>(root->getData());
     std::string ownerFn = fnNode->getName();
-    std::map<VarDecl*, VarStatement*> varDeclToVarStatement;
+    std::map<uint64_t, VarStatement*> symbolToVarStatement;
 
-    // Build VarDecl (clang) to VarStatement (our datatype) map
+    // Build symbol id (of the VarDecl) to VarStatement (our datatype) map
     root->dfs([&](CaptedASTNode* currentNode, int depth) -> void {
         VarStatement* varStatement = dyn_cast<VarStatement>(currentNode->getData());
         if (!varStatement) {
             return;
         }
 
-        VarDecl* varDecl = varStatement->getDecl();
-        assert(varDeclToVarStatement.count(varDecl) == 0);
-        varDeclToVarStatement.insert(std::make_pair(varDecl, varStatement));
+        uint64_t symbolId = varStatement->getSymbol().id;
+        assert(symbolToVarStatement.count(symbolId) == 0);
+        symbolToVarStatement.insert(std::make_pair(symbolId, varStatement));
     });
 
     // Register the VarStatement to DeclRefStatement that reference them
@@ -160,13 +160,12 @@ void clang::postCreateTree(CaptedASTNode* root) {
             return;
         }
 
-        VarDecl* varDecl = dyn_cast<VarDecl>(declRefStatement->getDecl());
-        if (!varDecl) {
+        if (!declRefStatement->isVarRef()) {
             return;
         }
 
-        auto it = varDeclToVarStatement.find(varDecl);
-        if (it == varDeclToVarStatement.end()) {
+        auto it = symbolToVarStatement.find(declRefStatement->getSymbol().id);
+        if (it == symbolToVarStatement.end()) {
             return;
         }
 
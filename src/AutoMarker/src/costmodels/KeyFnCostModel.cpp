@@ -1,4 +1,6 @@
 #include <vector>
+#include <cmath>
+#include <functional>
 #include "KeyFnCostModel.h"
 #include "markers/Marker.h"
 
@@ -74,3 +76,31 @@ float KeyFnCostModel::renameCost(CaptedASTNode* n1, CaptedASTNode* n2) const {
 
     return SimpleStatementCostModel::renameCost(n1, n2);
 }
+
+bool KeyFnCostModel::hasIntegerCosts() const {
+    // Renames of key functions add their costs to DEFAULT_COST, so whole
+    // number key function costs keep every cost whole
+    for (auto &it : keyFns) {
+        for (float cost : it.second) {
+            if (cost != std::floor(cost)) {
+                return false;
+            }
+        }
+    }
+
+    return SimpleStatementCostModel::hasIntegerCosts();
+}
+
+uint64_t KeyFnCostModel::getModelId() const {
+    // Every marker has its own key function table
+    uint64_t id = std::hash<std::string>()("KeyFnCostModel");
+
+    for (auto &it : keyFns) {
+        id = capted::hashCombine(id, std::hash<std::string>()(it.first));
+        for (float cost : it.second) {
+            id = capted::hashCombine(id, std::hash<float>()(cost));
+        }
+    }
+
+    return id;
+}
@@ -17,6 +17,9 @@ public:
     virtual float deleteCost(CaptedASTNode* n) const override;
     virtual float insertCost(CaptedASTNode* n) const override;
     virtual float renameCost(CaptedASTNode* n1, CaptedASTNode* n2) const override;
+
+    virtual bool hasIntegerCosts() const override;
+    virtual uint64_t getModelId() const override;
 };
 
 }
@@ -1,17 +1,10 @@
 #include <vector>
+#include <functional>
 #include "SimpleStatementCostModel.h"
 #include "Logger.h"
 
 using namespace clang;
 
-//------------------------------------------------------------------------------
-// Helpers
-//------------------------------------------------------------------------------
-
-bool typesAreEqual(const QualType &q1, const QualType &q2) {
-    return (q1.getCanonicalType().getAsString() != q2.getCanonicalType().getAsString());
-}
-
 //------------------------------------------------------------------------------
 // SimpleStatementCostModel
 //------------------------------------------------------------------------------
@@ -53,13 +46,38 @@ float SimpleStatementCostModel::renameCost(CaptedASTNode* n1, CaptedASTNode* n2)
         return NO_COST;
     }
 
-    if (n1->getData()->toString() == n2->getData()->toString()) {
+    // Not toString(), whose symbol ids differ between solutions
+    if (n1->getData()->getLabel() == n2->getData()->getLabel()) {
         return NO_COST;
     }
 
     return DEFAULT_COST;
 }
 
+bool SimpleStatementCostModel::hasIntegerCosts() const {
+    // Every cost is either DEFAULT_COST or NO_COST
+    return true;
+}
+
+bool SimpleStatementCostModel::hasZeroSelfRenameCost() const {
+    // renameCost() always returns NO_COST for statements with the same label
+    return true;
+}
+
+uint64_t SimpleStatementCostModel::labelHash(CaptedASTNode* n) const {
+    // getLabel() holds everything renameCost() reads from a single statement:
+    // its kind, the symbol of a reference and the read/write uses of a variable
+    // or the variable a reference points to. isCompatibleCondition() also reads
+    // the statements below a condition, which the subtree hashes cover. Symbol
+    // ids are left out, so the same subtree in different students and
+    // references has the same hash.
+    return std::hash<std::string>()(n->getData()->getLabel());
+}
+
+uint64_t SimpleStatementCostModel::getModelId() const {
+    return std::hash<std::string>()("SimpleStatementCostModel");
+}
+
 //------------------------------------------------------------------------------
 // Compatibility Checks
 //------------------------------------------------------------------------------
@@ -88,23 +106,23 @@ bool SimpleStatementCostModel::isCompatibleExternalVar(CaptedASTNode* n1, Capted
         return false;
     }
 
-    VarDecl* v1 = dyn_cast<VarDecl>(d1->getDecl());
-    VarDecl* v2 = dyn_cast<VarDecl>(d2->getDecl());
+    const SymbolInfo &v1 = d1->getSymbol();
+    const SymbolInfo &v2 = d2->getSymbol();
 
-    if (!v1 || !v2) {
+    if (v1.kind != SymbolInfo::SK_VAR || v2.kind != SymbolInfo::SK_VAR) {
         return false;
     }
 
-    if (v1->isLocalVarDeclOrParm() || v2->isLocalVarDeclOrParm()) {
+    if (v1.isLocal || v2.isLocal) {
         // Ignore local variables or parameters
         return false;
     }
 
-    if (typesAreEqual(v1->getType(), v2->getType())) {
+    if (v1.type != v2.type) {
         return false;
     }
 
-    if (v1->getNameAsString() != v2->getNameAsString()) {
+    if (v1.name != v2.name) {
         return false;
     }
 
@@ -163,33 +181,23 @@ bool SimpleStatementCostModel::isCompatibleFunctionDecl(CaptedASTNode* n1, Capte
 
     // Checks if 2 function references (when functions are referenced by pointers) are compatible
     // e.g. passing a function pointer as a param
-    FunctionDecl* f1 = dyn_cast<FunctionDecl>(d1->getDecl());
-    FunctionDecl* f2 = dyn_cast<FunctionDecl>(d2->getDecl());
+    const SymbolInfo &f1 = d1->getSymbol();
+    const SymbolInfo &f2 = d2->getSymbol();
 
-    if (!f1 || !f2) {
+    if (f1.kind != SymbolInfo::SK_FUNCTION || f2.kind != SymbolInfo::SK_FUNCTION) {
         return false;
     }
 
-    if (typesAreEqual(f1->getReturnType(), f2->getReturnType())) {
+    if (f1.type != f2.type) {
         return false;
     }
 
-    if (f1->getNameAsString() != f2->getNameAsString()) {
+    if (f1.name != f2.name) {
         return false;
     }
 
-    if (f1->getNumParams() != f2->getNumParams()) {
-        return false;
-    }
-
-    int n = f1->getNumParams();
-    for (int i = 0; i < n; i++) {
-        if (typesAreEqual(f1->getParamDecl(i)->getType(), f2->getParamDecl(i)->getType())) {
-            return false;
-        }
-    }
-
-    return true;
+    // Same number of parameters, each of the same type
+    return f1.paramTypes == f2.paramTypes;
 }
 
 bool SimpleStatementCostModel::isCompatibleLoop(CaptedASTNode* n1, CaptedASTNode* n2) const {
@@ -25,6 +25,11 @@ public:
     virtual float deleteCost(CaptedASTNode* n) const override;
     virtual float insertCost(CaptedASTNode* n) const override;
     virtual float renameCost(CaptedASTNode* n1, CaptedASTNode* n2) const override;
+
+    virtual bool hasIntegerCosts() const override;
+    virtual bool hasZeroSelfRenameCost() const override;
+    virtual uint64_t labelHash(CaptedASTNode* n) const override;
+    virtual uint64_t getModelId() const override;
 };
 
 }
@@ -1,12 +1,30 @@
+#include "Archive.h"
 #include "Logger.h"
+#include "ast/PrecompiledHeaders.h"
 #include "ast/Solution.h"
+#include "ast/SolutionCache.h"
 #include "markers/ECE459_A1_parallel.h"
 #include "markers/ECE459_A1_nbio.h"
+#include "results/ResultSink.h"
+#include "server/MarkingServer.h"
 
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Signals.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
 using namespace clang;
 using namespace clang::tooling;
 
@@ -27,10 +45,9 @@ static llvm::cl::extrahelp MoreHelp("See README for more info\n");
 
 //------------------------------------------------------------------------------
 
-static llvm::cl::opt<std::string>
+static llvm::cl::list<std::string>
 CAM_Marker("cam-marker"
-    , llvm::cl::desc("Marker to use (a1nbio, a1parallel)")
-    , llvm::cl::Required
+    , llvm::cl::desc("Marker to use (a1nbio, a1parallel), or several parts to mark in one run, each as <marker>=<student file>=<reference>,<reference>...")
     , llvm::cl::cat(CAMCategory)
 );
 
@@ -41,94 +58,656 @@ CAM_ReferenceSols("cam-reference-solution"
     , llvm::cl::cat(CAMCategory)
 );
 
+static llvm::cl::opt<std::string>
+CAM_StudentManifest("cam-student-manifest"
+    , llvm::cl::desc("File listing student solution files, one per line, to mark in one run")
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<std::string>
+CAM_ReferenceCache("cam-reference-cache"
+    , llvm::cl::desc("Directory of pruned reference solutions kept between runs")
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<int>
+CAM_Jobs("cam-jobs"
+    , llvm::cl::desc("Threads to parse solutions with (default: number of cores)")
+    , llvm::cl::init(std::thread::hardware_concurrency())
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<std::string>
+CAM_ArchiveMember("cam-archive-member"
+    , llvm::cl::desc("File to mark in student archives (.tar, .tar.gz, .tgz, .zip), by the end of its path, e.g. src/paster_nbio.c")
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<bool>
+CAM_PCH("cam-pch"
+    , llvm::cl::desc("Precompile the system headers solutions start with (default: true)")
+    , llvm::cl::init(true)
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<std::string>
+CAM_PCHCache("cam-pch-cache"
+    , llvm::cl::desc("Directory of precompiled headers kept between runs (default: a temporary one)")
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<std::string>
+CAM_ResultsFormat("cam-results-format"
+    , llvm::cl::desc("How to write each comparison: text, among the rest of stdout, jsonl or columnar, see results/ResultSink.h (default: text)")
+    , llvm::cl::init("text")
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<std::string>
+CAM_Results("cam-results"
+    , llvm::cl::desc("File to append jsonl or columnar results to")
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<bool>
+CAM_Stats("cam-stats"
+    , llvm::cl::desc("Print cache hit rates and sizes to stderr after marking each student, counted from the start of the run")
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<std::string>
+CAM_Serve("cam-serve"
+    , llvm::cl::desc("Unix socket to serve marking requests on, see server/MarkingServer.h")
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::list<std::string>
+CAM_ServeMarkers("cam-serve-marker"
+    , llvm::cl::desc("A marker to serve and its reference solutions, as <marker>=<file>,<file>...")
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<int>
+CAM_ServeWorkers("cam-serve-workers"
+    , llvm::cl::desc("Requests marked at once (default: number of cores)")
+    , llvm::cl::init(std::thread::hardware_concurrency())
+    , llvm::cl::cat(CAMCategory)
+);
+
+static llvm::cl::opt<int>
+CAM_ServeTimeLimit("cam-serve-time-limit"
+    , llvm::cl::desc("Seconds before a request is killed (default: 120)")
+    , llvm::cl::init(120)
+    , llvm::cl::cat(CAMCategory)
+);
+
 //------------------------------------------------------------------------------
 // Main
 //------------------------------------------------------------------------------
 
+// Shared by every marker, nullptr with -cam-pch=false
+static std::unique_ptr<PrecompiledHeaders> precompiledHeaders;
+
+// Shared by every marker, and by forked children through the same file
+static std::unique_ptr<ResultSink> resultSink;
+
+// Student archives read so far, by path. Their source members are mapped into
+// every ClangTool, and kept for the lifetime of the process since the ASTs point
+// into them.
+static std::map<std::string, std::unique_ptr<Archive>> studentArchives;
+
 void gcSolutions(std::vector<Solution*> &solutions) {
     for (Solution* sol : solutions) {
         delete sol;
     }
 }
 
-int main(int argc, const char* argv[]) {
-    llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
-    CommonOptionsParser optionsParser(argc, argv, CAMCategory);
+// ClangTool changes the working directory of the whole process to that of the
+// compile command while it parses, so files can only be parsed in parallel when
+// that is a no-op
+bool compilesInWorkingDirectory(const CompilationDatabase &compilations, const std::vector<std::string> &files) {
+    llvm::SmallString<256> workingDirectory;
+    if (llvm::sys::fs::current_path(workingDirectory)) {
+        return false;
+    }
 
-    // Need to do AST processing via ClangTool in main() so that the clang ASTs
-    // don't get garbage collected before we reach Marker::run()
+    for (const std::string &file : files) {
+        for (const CompileCommand &command : compilations.getCompileCommands(file)) {
+            bool same = false;
+            if (llvm::sys::fs::equivalent(command.Directory, workingDirectory, same) || !same) {
+                return false;
+            }
+        }
+    }
 
-    const std::vector<std::string> &studentFiles = optionsParser.getSourcePathList();
-    const std::vector<std::string> &referenceFiles = CAM_ReferenceSols;
-    std::vector<Solution*> studentSols;
-    std::vector<Solution*> referenceSols;
+    return true;
+}
 
-    //-------------------------------------------------------------------------
-    // Student Files
-    //-------------------------------------------------------------------------
+// Returns the virtual path of member. Each archive is only read once, however
+// many parts are marked from it.
+std::string openStudentArchive(const std::string &path, const std::string &member) {
+    if (member.empty()) {
+        Logger::abortError("Use -cam-archive-member to mark archive " + path);
+    }
 
-    if (studentFiles.size() == 0) {
-        Logger::abortError("No student solutions provided");
+    std::unique_ptr<Archive> &archive = studentArchives[path];
+    if (!archive) {
+        archive.reset(new Archive(path));
+    }
+
+    std::string studentFile = archive->findFile(member);
+    if (studentFile.empty()) {
+        Logger::abortError("No " + member + " in archive " + path);
+    }
+    return studentFile;
+}
+
+std::string readSource(const std::string &file) {
+    for (auto &archive : studentArchives) {
+        auto it = archive.second->getFiles().find(file);
+        if (it != archive.second->getFiles().end()) {
+            return it->second;
+        }
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> contents = llvm::MemoryBuffer::getFile(file);
+    return contents ? (*contents)->getBuffer().str() : "";
+}
+
+std::unique_ptr<ASTUnit> buildAST(const CompilationDatabase &compilations, const std::string &file, const std::string &pchPath) {
+    std::vector<std::unique_ptr<ASTUnit>> asts;
+    ClangTool parser(compilations, {file});
+    for (auto &archive : studentArchives) {
+        for (auto &it : archive.second->getFiles()) {
+            parser.mapVirtualFile(it.first, it.second);
+        }
+    }
+    if (!pchPath.empty()) {
+        parser.appendArgumentsAdjuster(getInsertArgumentAdjuster({"-include-pch", pchPath}, ArgumentInsertPosition::BEGIN));
+    }
+
+    if (parser.buildASTs(asts) != 0 || asts.size() != 1) {
+        return nullptr;
+    }
+
+    // A PCH whose headers changed since is a fatal error
+    if (!pchPath.empty() && asts[0]->getDiagnostics().hasFatalErrorOccurred()) {
+        return nullptr;
+    }
+    return std::move(asts[0]);
+}
+
+// Each file gets its own ClangTool, on one of -cam-jobs threads, and is turned
+// into a Solution on the thread that parsed it. Files starting with the
+// marker's precompiledHeaders are parsed with a PCH. Only neededFunctions are
+// mapped up front, if given.
+//
+// Solutions don't point into the clang ASTs, so an AST is freed as soon as its
+// Solution is built, unless the Solution still has functions to map on demand,
+// in which case it is handed to the caller. On failure nothing is returned, as
+// with ClangTool::buildASTs().
+std::vector<Solution*> buildSolutions(const CompilationDatabase &compilations, const std::vector<std::string> &files, const std::set<std::string> &headers, const std::set<std::string>* neededFunctions, std::vector<std::unique_ptr<ASTUnit>> &asts) {
+    std::vector<std::unique_ptr<ASTUnit>> fileASTs(files.size());
+    std::vector<Solution*> fileSols(files.size(), nullptr);
+    std::atomic<size_t> nextFile(0);
+
+    auto parseFiles = [&]() {
+        for (size_t i = nextFile++; i < files.size(); i = nextFile++) {
+            std::string pchPath = precompiledHeaders ? precompiledHeaders->getPCH(compilations, files[i], readSource(files[i]), headers) : "";
+            std::unique_ptr<ASTUnit> ast = buildAST(compilations, files[i], pchPath);
+
+            // Only costs a second parse if the PCH has gone stale
+            if (!ast && !pchPath.empty()) {
+                ast = buildAST(compilations, files[i], "");
+            }
+            if (!ast) {
+                continue;
+            }
+
+            fileSols[i] = new Solution(ast->getASTContext().getTranslationUnitDecl(), neededFunctions);
+            if (fileSols[i]->hasUnmappedFunctions()) {
+                fileASTs[i] = std::move(ast);
+            }
+        }
+    };
+
+    size_t numThreads = std::min(files.size(), (size_t)std::max(1, (int)CAM_Jobs));
+    if (numThreads > 1 && !compilesInWorkingDirectory(compilations, files)) {
+        numThreads = 1;
+    }
+
+    // This thread is one of them
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; i++) {
+        threads.emplace_back(parseFiles);
+    }
+    parseFiles();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<Solution*> solutions;
+    if (std::find(fileSols.begin(), fileSols.end(), nullptr) != fileSols.end()) {
+        gcSolutions(fileSols);
+        return solutions;
+    }
+
+    for (std::unique_ptr<ASTUnit> &ast : fileASTs) {
+        if (ast) {
+            asts.push_back(std::move(ast));
+        }
+    }
+    return fileSols;
+}
+
+std::vector<std::string> readStudentManifest(const std::string &path) {
+    std::ifstream manifest(path);
+    if (!manifest) {
+        Logger::abortError("Cannot open student manifest " + path);
+    }
+
+    std::vector<std::string> studentFiles;
+    std::string line;
+    while (std::getline(manifest, line)) {
+        if (!line.empty()) {
+            studentFiles.push_back(line);
+        }
+    }
+
+    return studentFiles;
+}
+
+// Pruned references for marker, from the -cam-reference-cache if possible. The
+// rest are parsed, pruned and stored for the next run.
+std::vector<Solution*> loadReferences(Marker* marker, const CompilationDatabase &compilations, const std::vector<std::string> &referenceFiles) {
+    // Stays empty, references are mapped in full
+    std::vector<std::unique_ptr<ASTUnit>> asts;
+
+    if (CAM_ReferenceCache.empty()) {
+        std::vector<Solution*> referenceSols = buildSolutions(compilations, referenceFiles, marker->getPrecompiledHeaders(), nullptr, asts);
+        if (referenceSols.size() != referenceFiles.size()) {
+            Logger::abortError("Failed to build reference ASTs");
+        }
+        return referenceSols;
+    }
+
+    SolutionCache cache(CAM_ReferenceCache);
+    std::vector<Solution*> referenceSols(referenceFiles.size(), nullptr);
+    std::vector<std::string> keys(referenceFiles.size());
+    std::vector<std::string> missingFiles;
+
+    for (size_t i = 0; i < referenceFiles.size(); i++) {
+        keys[i] = SolutionCache::makeKey(referenceFiles[i], compilations.getCompileCommands(referenceFiles[i]), marker->getKeyFns());
+        if (!keys[i].empty()) {
+            referenceSols[i] = cache.load(keys[i]);
+        }
+        if (!referenceSols[i]) {
+            missingFiles.push_back(referenceFiles[i]);
+        }
+    }
+
+    std::vector<Solution*> parsedSols = buildSolutions(compilations, missingFiles, marker->getPrecompiledHeaders(), nullptr, asts);
+    if (parsedSols.size() != missingFiles.size()) {
+        Logger::abortError("Failed to build reference ASTs");
+    }
+
+    std::set<std::string> interestingFunctions = marker->getInterestingFunctions();
+    auto parsedIt = parsedSols.begin();
+    for (size_t i = 0; i < referenceFiles.size(); i++) {
+        if (referenceSols[i]) {
+            continue;
+        }
+
+        referenceSols[i] = *parsedIt++;
+        referenceSols[i]->pruneFunctions(interestingFunctions);
+        if (!keys[i].empty()) {
+            cache.store(keys[i], referenceSols[i]);
+        }
+    }
+
+    if (CAM_Stats) {
+        std::cerr << "Reference cache hits:" << cache.getHits() << " misses:" << cache.getMisses() << std::endl;
     }
+    return referenceSols;
+}
 
-    if (studentFiles.size() != 1) {
-        // We could technically process more than 1 student solution per LLVM instance (process)
-        // but it's more reliable if we create a new process via Python script per student in case
-        // the compiler crashes -- we don't want to break the compiler if there's a malformed
-        // student submission, especially if it's a long batch job with hundreds of students
-        Logger::abortError("Must provide 1 input file for student solution");
+Marker* createMarker(const std::string &markerName) {
+    Marker* marker = nullptr;
+    if (markerName == "a1nbio") {
+        marker = new ece459::A1nbio();
+    } else if (markerName == "a1parallel") {
+        marker = new ece459::A1parallel();
+    } else {
+        Logger::abortError("Unknown marker specified: " + markerName);
     }
 
-    ClangTool studentParser(optionsParser.getCompilations(), studentFiles);
+    marker->setResultSink(resultSink.get());
+    return marker;
+}
+
+void markStudent(Marker* marker, const CompilationDatabase &compilations, const std::string &studentPath) {
+    std::string studentFile = Archive::isArchive(studentPath) ? openStudentArchive(studentPath, CAM_ArchiveMember) : studentPath;
+    std::vector<std::string> studentFiles = {studentFile};
     std::vector<std::unique_ptr<ASTUnit>> studentASTs;
-    int studentSuccess = studentParser.buildASTs(studentASTs);
-    if (studentSuccess != 0) {
+    std::set<std::string> neededFunctions = marker->getNeededFunctions();
+    std::vector<Solution*> studentSols = buildSolutions(compilations, studentFiles, marker->getPrecompiledHeaders(), &neededFunctions, studentASTs);
+    if (studentSols.size() != 1) {
         Logger::abortError("Failed to build student ASTs");
     }
 
-    for (std::unique_ptr<ASTUnit> &astPtr : studentASTs) {
-        Solution* sol = new Solution(astPtr->getASTContext().getTranslationUnitDecl());
-        studentSols.push_back(sol);
+    marker->setStudentFiles(studentFiles, studentSols);
+    marker->run();
+    resultSink->flush();
+    if (CAM_Stats) {
+        marker->printStats();
+    }
+
+    gcSolutions(studentSols);
+}
+
+// Runs mark in a forked child and waits for it. Returns false, after saying so,
+// if the child crashed or aborted.
+//
+// If given, report runs in the child after mark, and what it returns is handed
+// back in reported, so the parent can keep what the child learnt.
+bool markInChild(const std::string &description, const std::function<void()> &mark,
+                 const std::function<std::string()> &report = nullptr, std::string* reported = nullptr) {
+    // Otherwise buffered output is written again by the child
+    std::cout.flush();
+    std::cerr.flush();
+    resultSink->flush();
+
+    int reportPipe[2] = {-1, -1};
+    if (report && pipe(reportPipe) == -1) {
+        Logger::abortError("Failed to create a pipe for " + description);
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        Logger::abortError("Failed to fork for " + description);
+    }
+
+    if (pid == 0) {
+        mark();
+        std::cout.flush();
+        std::cerr.flush();
+
+        if (report) {
+            close(reportPipe[0]);
+            std::string data = report();
+            for (size_t written = 0; written < data.size();) {
+                ssize_t n = write(reportPipe[1], data.data() + written, data.size() - written);
+                if (n == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    _exit(1);
+                }
+                written += n;
+            }
+            close(reportPipe[1]);
+        }
+        _exit(0);
+    }
+
+    // Read while the child writes, it would block on a full pipe otherwise
+    if (report) {
+        close(reportPipe[1]);
+        reported->clear();
+        char buffer[64 * 1024];
+        ssize_t n;
+        while ((n = read(reportPipe[0], buffer, sizeof(buffer))) != 0) {
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            reported->append(buffer, n);
+        }
+        close(reportPipe[0]);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+        // retry
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "Failed to mark " << description;
+        if (WIFSIGNALED(status)) {
+            std::cerr << " (signal " << WTERMSIG(status) << ")";
+        }
+        std::cerr << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Each student is marked in a child process so that a malformed submission
+// that crashes the compiler only loses that student. The children inherit the
+// parsed and pruned references copy-on-write, so those are only built once per
+// run. Students are marked one at a time since they share stdout.
+//
+// Each child hands the cache entries it added back to the parent, so the next
+// student starts from every comparison made before, as it would in a single
+// process. A child that crashes hands back nothing.
+//
+// Returns the number of students that could not be marked
+int markStudentsInChildren(Marker* marker, const CompilationDatabase &compilations, const std::vector<std::string> &studentFiles) {
+    int failures = 0;
+
+    for (const std::string &studentFile : studentFiles) {
+        Marker::CacheMark mark = marker->getCacheMark();
+        std::string exported;
+        bool marked = markInChild(studentFile, [&]() { markStudent(marker, compilations, studentFile); },
+                                  [&]() { return marker->exportCaches(mark); }, &exported);
+        if (marked) {
+            marker->importCaches(exported);
+        } else {
+            failures++;
+        }
+    }
+
+    if (CAM_Stats) {
+        std::cerr << "Across " << studentFiles.size() << " students:" << std::endl;
+        marker->printStats();
+    }
+
+    return failures;
+}
+
+// "<file>,<file>..." as given to -cam-marker and -cam-serve-marker
+std::vector<std::string> splitFileList(llvm::StringRef list) {
+    llvm::SmallVector<llvm::StringRef, 4> files;
+    list.split(files, ',', -1, false);
+
+    std::vector<std::string> fileList;
+    for (llvm::StringRef file : files) {
+        fileList.push_back(file.str());
+    }
+    return fileList;
+}
+
+// One part of an assignment, from -cam-marker=<marker>=<student file>=<references>
+struct MarkingPart {
+    std::string markerName;
+    std::string studentFile;
+    std::vector<std::string> referenceFiles;
+};
+
+// Marks every part of a student's assignment in one process, instead of one
+// process per part, so they share the compilation database, the PCH directory,
+// the reference cache and the student's archive, which is read once up front.
+// The references of a part only matter to that part, so each part is marked in
+// its own child, which parses them; a part that crashes the compiler doesn't
+// lose the others.
+//
+// In an archive, a part marks the file its references are versions of, e.g.
+// paster_nbio.c. -cam-archive-member can only stand in for that with a single
+// part, as each part marks a different file.
+//
+// Returns the number of parts that could not be marked
+int markParts(const CompilationDatabase &compilations, const std::vector<MarkingPart> &parts) {
+    if (parts.size() > 1 && !CAM_ArchiveMember.empty()) {
+        Logger::abortError("-cam-archive-member would mark the same file for every part, leave it out to mark the file each part's references are named after");
+    }
+
+    int failures = 0;
+
+    for (const MarkingPart &part : parts) {
+        std::string studentFile = part.studentFile;
+        if (Archive::isArchive(studentFile)) {
+            if (CAM_ArchiveMember.empty() && part.referenceFiles.empty()) {
+                Logger::abortError("Use -cam-archive-member or give references to mark archive " + studentFile + " with " + part.markerName);
+            }
+            std::string member = CAM_ArchiveMember.empty() ? llvm::sys::path::filename(part.referenceFiles[0]).str() : CAM_ArchiveMember;
+            studentFile = openStudentArchive(studentFile, member);
+        }
+
+        bool marked = markInChild(part.markerName + " of " + part.studentFile, [&]() {
+            std::unique_ptr<Marker> marker(createMarker(part.markerName));
+            std::vector<Solution*> referenceSols = loadReferences(marker.get(), compilations, part.referenceFiles);
+            marker->setReferenceFiles(part.referenceFiles, referenceSols);
+
+            markStudent(marker.get(), compilations, studentFile);
+            gcSolutions(referenceSols);
+        });
+        if (!marked) {
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+// Keeps one marker per -cam-serve-marker, with its references parsed and
+// pruned, for the lifetime of the daemon
+int serve(const CompilationDatabase &compilations) {
+    if (CAM_ServeMarkers.empty()) {
+        Logger::abortError("No markers to serve, use -cam-serve-marker");
+    }
+
+    std::map<std::string, Marker*> markers;
+    std::vector<std::unique_ptr<Marker>> markerPtrs;
+    std::vector<Solution*> referenceSols;
+
+    for (const std::string &spec : CAM_ServeMarkers) {
+        size_t equals = spec.find('=');
+        std::string markerName = spec.substr(0, equals);
+        std::vector<std::string> referenceFiles;
+        if (equals != std::string::npos) {
+            referenceFiles = splitFileList(llvm::StringRef(spec).substr(equals + 1));
+        }
+
+        if (markers.count(markerName) != 0) {
+            Logger::abortError("Marker served twice: " + markerName);
+        }
+
+        markerPtrs.emplace_back(createMarker(markerName));
+
+        std::vector<Solution*> sols = loadReferences(markerPtrs.back().get(), compilations, referenceFiles);
+        markerPtrs.back()->setReferenceFiles(referenceFiles, sols);
+        markers[markerName] = markerPtrs.back().get();
+
+        referenceSols.insert(referenceSols.end(), sols.begin(), sols.end());
     }
 
-    assert(studentSols.size() == 1);
+    MarkingServer server(CAM_Serve, markers, [&](Marker* marker, const std::string &studentFile) {
+        markStudent(marker, compilations, studentFile);
+    }, CAM_ServeWorkers, std::chrono::seconds(CAM_ServeTimeLimit));
+    server.run();
+
+    gcSolutions(referenceSols);
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
+
+    // Student files may all come from the manifest, or from requests
+    CommonOptionsParser optionsParser(argc, argv, CAMCategory, llvm::cl::ZeroOrMore);
+
+    if (CAM_PCH) {
+        precompiledHeaders.reset(new PrecompiledHeaders(CAM_PCHCache));
+    }
+    resultSink.reset(ResultSink::create(CAM_ResultsFormat, CAM_Results));
+
+    if (!CAM_Serve.empty()) {
+        return serve(optionsParser.getCompilations());
+    }
 
     //-------------------------------------------------------------------------
-    // Reference Files
-    // Note: Not all markers need reference solutions to work so this is set as
-    //       an optional compiler flag
+    // Parts
+    // Each -cam-marker names its own student and reference files
     //-------------------------------------------------------------------------
 
-    ClangTool referenceParser(optionsParser.getCompilations(), referenceFiles);
-    std::vector<std::unique_ptr<ASTUnit>> referenceASTs;
-    int referenceSuccess = referenceParser.buildASTs(referenceASTs);
-    if (referenceSuccess != 0) {
-        Logger::abortError("Failed to build reference ASTs");
+    std::vector<MarkingPart> parts;
+    for (const std::string &spec : CAM_Marker) {
+        llvm::SmallVector<llvm::StringRef, 3> fields;
+        llvm::StringRef(spec).split(fields, '=', 2);
+        if (fields.size() == 1) {
+            continue;
+        }
+        if (fields.size() != 3 || fields[1].empty()) {
+            Logger::abortError("Expected -cam-marker=<marker>=<student file>=<reference>,<reference>... but got " + spec);
+        }
+
+        parts.push_back({fields[0].str(), fields[1].str(), splitFileList(fields[2])});
+    }
+
+    if (!parts.empty()) {
+        if (parts.size() != CAM_Marker.size() || !optionsParser.getSourcePathList().empty() || !CAM_StudentManifest.empty() || !CAM_ReferenceSols.empty()) {
+            Logger::abortError("Give either several -cam-marker parts, or one -cam-marker with its student and reference files");
+        }
+
+        return markParts(optionsParser.getCompilations(), parts) == 0 ? 0 : 1;
+    }
+
+    std::vector<std::string> studentFiles = optionsParser.getSourcePathList();
+    const std::vector<std::string> &referenceFiles = CAM_ReferenceSols;
+
+    //-------------------------------------------------------------------------
+    // Student Files
+    //-------------------------------------------------------------------------
+
+    if (!CAM_StudentManifest.empty()) {
+        std::vector<std::string> manifestFiles = readStudentManifest(CAM_StudentManifest);
+        studentFiles.insert(studentFiles.end(), manifestFiles.begin(), manifestFiles.end());
     }
 
-    for (std::unique_ptr<ASTUnit> &astPtr : referenceASTs) {
-        Solution* sol = new Solution(astPtr->getASTContext().getTranslationUnitDecl());
-        referenceSols.push_back(sol);
+    if (studentFiles.size() == 0) {
+        Logger::abortError("No student solutions provided");
     }
 
     //-------------------------------------------------------------------------
     // Marker
     //-------------------------------------------------------------------------
 
-    std::unique_ptr<Marker> marker;
-    if (CAM_Marker == "a1nbio") {
-        marker.reset(new ece459::A1nbio());
-    } else if (CAM_Marker == "a1parallel") {
-        marker.reset(new ece459::A1parallel());
-    } else {
-        Logger::abortError("Unknown marker specified: " + CAM_Marker);
+    if (CAM_Marker.size() != 1) {
+        Logger::abortError("Use one -cam-marker, or give each its own student and reference files");
     }
 
-    marker->setStudentFiles(studentFiles, studentSols);
+    std::unique_ptr<Marker> marker(createMarker(CAM_Marker[0]));
+
+    //-------------------------------------------------------------------------
+    // Reference Files
+    // Note: Not all markers need reference solutions to work so this is set as
+    //       an optional compiler flag
+    //-------------------------------------------------------------------------
+
+    std::vector<Solution*> referenceSols = loadReferences(marker.get(), optionsParser.getCompilations(), referenceFiles);
+
+    // Prunes the references for every student below
     marker->setReferenceFiles(referenceFiles, referenceSols);
-    marker->run();
 
-    gcSolutions(studentSols);
+    int failures = 0;
+    if (studentFiles.size() == 1 && CAM_StudentManifest.empty()) {
+        markStudent(marker.get(), optionsParser.getCompilations(), studentFiles[0]);
+    } else {
+        failures = markStudentsInChildren(marker.get(), optionsParser.getCompilations(), studentFiles);
+    }
+
     gcSolutions(referenceSols);
-    return 0;
+    return failures == 0 ? 0 : 1;
 }
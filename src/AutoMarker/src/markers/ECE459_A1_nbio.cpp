@@ -27,6 +27,10 @@ A1nbio::A1nbio()
         {"curl_multi_timeout",       {10, 10}},
         {"curl_multi_wait",          {10, 10}},
         {"select",                   {10, 10}},
+    }, {
+        "errno.h", "stdarg.h", "stdbool.h", "stdio.h", "stdlib.h", "string.h", "unistd.h",
+        "sys/select.h", "sys/time.h",
+        "png.h", "curl/curl.h",
     }) {
     // nop
 }
@@ -57,8 +61,6 @@ void A1nbio::markAssignment() {
 
     // Iterate over each solution
     for (Solution* referenceSol : referenceSols) {
-        referenceSol->pruneFunctions(interestingFunctions);
-
         // Iterate over each student function
         for (auto &studentIter : *(studentSols[0])) {
             std::string fnName = studentIter.first;
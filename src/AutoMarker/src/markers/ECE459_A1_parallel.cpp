@@ -16,6 +16,10 @@ A1parallel::A1parallel()
 
         {"pthread_create", {100, 100}},
         {"pthread_join",   {100, 100}},
+    }, {
+        "errno.h", "stdarg.h", "stdbool.h", "stdio.h", "stdlib.h", "string.h", "unistd.h",
+        "pthread.h",
+        "png.h", "curl/curl.h",
     }) {
     // nop
 }
@@ -33,8 +37,9 @@ CaptedASTNode* findPthreadFn(Solution* sol) {
     static const int PTHREAD_FN_IDX = 2;
     CaptedASTNode* pthreadFnNode = nullptr;
 
-    for (auto &solIter : *sol) {
-        CaptedASTNode* fn = solIter.second;
+    // Student helpers that call it may not have been mapped yet
+    for (const std::string &callerName : sol->getCallersOf(PTHREAD_CALLER)) {
+        CaptedASTNode* fn = sol->getFunction(callerName);
         fn->dfs([&](CaptedASTNode* currentNode, int depth) -> void {
             CallStatement* callStatement = dyn_cast<CallStatement>(currentNode->getData());
             if (!callStatement) {
@@ -51,7 +56,7 @@ CaptedASTNode* findPthreadFn(Solution* sol) {
             }
 
             DeclRefStatement* declRefStatement = cast<DeclRefStatement>(pthreadFnRefNode->getData());
-            assert(isa<FunctionDecl>(declRefStatement->getDecl()));
+            assert(declRefStatement->getSymbol().kind == SymbolInfo::SK_FUNCTION);
             pthreadFnNode = sol->getFunction(declRefStatement->getName());
         });
     }
@@ -73,7 +78,6 @@ void A1parallel::markAssignment() {
 
     // Iterate over each solution
     for (Solution* referenceSol : referenceSols) {
-        referenceSol->pruneFunctions(interestingFunctions);
         CaptedASTNode* referencePthreadFn = findPthreadFn(referenceSol);
 
         calculateASTDiff(studentPthreadFn, referencePthreadFn, studentSols[0]->getFileName(), referenceSol->getFileName());
@@ -1,6 +1,8 @@
 #include "Marker.h"
 #include "Logger.h"
 #include "costmodels/KeyFnCostModel.h"
+#include <chrono>
+#include <cstring>
 #include <iostream>
 
 using namespace clang;
@@ -11,9 +13,12 @@ using std::endl;
 // Marker
 //------------------------------------------------------------------------------
 
-Marker::Marker(std::string markerName, const std::map<std::string, std::vector<float>> keyFns)
+Marker::Marker(std::string markerName, const std::map<std::string, std::vector<float>> keyFns, const std::set<std::string> precompiledHeaders)
     : markerName(markerName)
-    , keyFns(keyFns) {
+    , subtreeCache(SUBTREE_CACHE_BYTES)
+    , strategyCache(STRATEGY_CACHE_BYTES)
+    , keyFns(keyFns)
+    , precompiledHeaders(precompiledHeaders) {
     // nop
 }
 
@@ -27,21 +32,175 @@ void Marker::run() {
     printFooter();
 }
 
+void Marker::printStats() const {
+    std::cerr << "Subtree cache hits:" << subtreeCache.getHits() << " misses:" << subtreeCache.getMisses()
+              << " bytes:" << subtreeCache.getSizeBytes() << "/" << subtreeCache.getCapacityBytes()
+              << " evictions:" << subtreeCache.getEvictions() << std::endl;
+    std::cerr << "Strategy cache hits:" << strategyCache.getHits() << " misses:" << strategyCache.getMisses()
+              << " bytes:" << strategyCache.getSizeBytes() << "/" << strategyCache.getCapacityBytes()
+              << " evictions:" << strategyCache.getEvictions() << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Cache Export
+//------------------------------------------------------------------------------
+
+// Both ends are the same binary, so values are copied as they are in memory.
+
+template <class T>
+static void writeValue(std::string &out, const T &value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T>
+static void writeVector(std::string &out, const std::vector<T> &values) {
+    writeValue(out, values.size());
+    out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <class T>
+static void readValue(const std::string &in, size_t &offset, T &value) {
+    if (offset + sizeof(T) > in.size()) {
+        Logger::abortError("Truncated cache export");
+    }
+    memcpy(&value, in.data() + offset, sizeof(T));
+    offset += sizeof(T);
+}
+
+template <class T>
+static void readVector(const std::string &in, size_t &offset, std::vector<T> &values) {
+    size_t size;
+    readValue(in, offset, size);
+    if (size > (in.size() - offset) / sizeof(T)) {
+        Logger::abortError("Truncated cache export");
+    }
+    values.resize(size);
+    memcpy(values.data(), in.data() + offset, size * sizeof(T));
+    offset += size * sizeof(T);
+}
+
+Marker::CacheMark Marker::getCacheMark() const {
+    CacheMark mark;
+    mark.subtreeInsertions = subtreeCache.getInsertions();
+    mark.subtreeHits = subtreeCache.getHits();
+    mark.subtreeMisses = subtreeCache.getMisses();
+    mark.strategyInsertions = strategyCache.getInsertions();
+    mark.strategyHits = strategyCache.getHits();
+    mark.strategyMisses = strategyCache.getMisses();
+    return mark;
+}
+
+std::string Marker::exportCaches(const CacheMark &mark) const {
+    std::string out;
+
+    writeValue(out, subtreeCache.getHits() - mark.subtreeHits);
+    writeValue(out, subtreeCache.getMisses() - mark.subtreeMisses);
+    writeValue(out, strategyCache.getHits() - mark.strategyHits);
+    writeValue(out, strategyCache.getMisses() - mark.strategyMisses);
+
+    // Each entry is preceded by a 1 for the subtree cache or 2 for the
+    // strategy cache
+    subtreeCache.forEachInsertedSince(mark.subtreeInsertions, [&](const capted::SubtreeCache::Key &key, const capted::SubtreeCache::Entry &entry) {
+        writeValue(out, (char)1);
+        writeValue(out, key);
+        writeValue(out, entry.distance);
+        writeVector(out, entry.delta);
+    });
+    strategyCache.forEachInsertedSince(mark.strategyInsertions, [&](const capted::StrategyCache::Key &key, const capted::StrategyCache::Entry &entry) {
+        writeValue(out, (char)2);
+        writeValue(out, key);
+        writeValue(out, entry.cost);
+        writeVector(out, entry.sizes1);
+        writeVector(out, entry.sizes2);
+        writeVector(out, entry.strategy);
+    });
+
+    return out;
+}
+
+void Marker::importCaches(const std::string &exported) {
+    size_t offset = 0;
+
+    long hits, misses;
+    readValue(exported, offset, hits);
+    readValue(exported, offset, misses);
+    subtreeCache.addLookups(hits, misses);
+    readValue(exported, offset, hits);
+    readValue(exported, offset, misses);
+    strategyCache.addLookups(hits, misses);
+
+    while (offset < exported.size()) {
+        char cache;
+        readValue(exported, offset, cache);
+
+        if (cache == 1) {
+            capted::SubtreeCache::Key key;
+            auto entry = std::make_shared<capted::SubtreeCache::Entry>();
+            readValue(exported, offset, key);
+            readValue(exported, offset, entry->distance);
+            readVector(exported, offset, entry->delta);
+            subtreeCache.insert(key, entry);
+        } else if (cache == 2) {
+            capted::StrategyCache::Key key;
+            auto entry = std::make_shared<capted::StrategyCache::Entry>();
+            readValue(exported, offset, key);
+            readValue(exported, offset, entry->cost);
+            readVector(exported, offset, entry->sizes1);
+            readVector(exported, offset, entry->sizes2);
+            readVector(exported, offset, entry->strategy);
+            strategyCache.insert(key, entry);
+        } else {
+            Logger::abortError("Malformed cache export");
+        }
+    }
+}
+
 void Marker::calculateASTDiff(CaptedASTNode* studentFnAST, CaptedASTNode* referenceFnAST, std::string studentFileName, std::string referenceFileName) {
+    assert(resultSink);
+
     KeyFnCostModel costModel(keyFns);
-    capted::Apted<SimpleStatement> algorithm(&costModel);
+    capted::EditDistanceResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    // 16 bit distances halve the memory traffic of float ones, for all but
+    // very large functions
+    if (costModel.hasIntegerCosts()) {
+        try {
+            result = computeDiff<int16_t>(&costModel, studentFnAST, referenceFnAST);
+        } catch (const capted::CostTypeOverflow &e) {
+            result = computeDiff<int32_t>(&costModel, studentFnAST, referenceFnAST);
+        }
+    } else {
+        result = computeDiff<float>(&costModel, studentFnAST, referenceFnAST);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
 
-    float diff = algorithm.computeEditDistance(studentFnAST, referenceFnAST); // src to dest
     FunctionStatement* studentFnNode = cast<FunctionStatement>(studentFnAST->getData());
     FunctionStatement* referenceFnNode = cast<FunctionStatement>(referenceFnAST->getData());
 
-    cout
-        << "stuFile:" << studentFileName << " "
-        << "refFile:" << referenceFileName << " "
-        << "stuFn:" << studentFnNode->getName() << " "
-        << "refFn:" << referenceFnNode->getName() << " "
-        << "diff:" << diff << " "
-        << endl;
+    DiffResult diffResult;
+    diffResult.studentFile = studentFileName;
+    diffResult.referenceFile = referenceFileName;
+    diffResult.studentFn = studentFnNode->getName();
+    diffResult.referenceFn = referenceFnNode->getName();
+    diffResult.distance = result.distance;
+    diffResult.approximate = result.approximate;
+    diffResult.lowerBound = result.lowerBound;
+    diffResult.upperBound = result.upperBound;
+    diffResult.studentNodes = studentFnAST->getNodeCount();
+    diffResult.referenceNodes = referenceFnAST->getNodeCount();
+    diffResult.micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    resultSink->write(diffResult);
+}
+
+template <class Cost>
+capted::EditDistanceResult Marker::computeDiff(capted::CostModel<SimpleStatement>* costModel, CaptedASTNode* studentFnAST, CaptedASTNode* referenceFnAST) {
+    capted::Apted<SimpleStatement, Cost> algorithm(costModel);
+    algorithm.setSubtreeCache(&subtreeCache);
+    algorithm.setStrategyCache(&strategyCache);
+    algorithm.setMemoryBudget(MEMORY_BUDGET_BYTES, capted::BudgetPolicy::FILE_BACKED);
+    algorithm.setTimeBudget(std::chrono::milliseconds(COMPARISON_TIME_LIMIT_MS));
+    return algorithm.computeBoundedEditDistance(studentFnAST, referenceFnAST); // src to dest
 }
 
 std::set<std::string> Marker::getInterestingFunctions() const {
@@ -54,6 +213,25 @@ std::set<std::string> Marker::getInterestingFunctions() const {
     return interestingFunctions;
 }
 
+const std::map<std::string, std::vector<float>> &Marker::getKeyFns() const {
+    return keyFns;
+}
+
+const std::set<std::string> &Marker::getPrecompiledHeaders() const {
+    return precompiledHeaders;
+}
+
+std::set<std::string> Marker::getNeededFunctions() const {
+    std::set<std::string> neededFunctions = {"main"};
+
+    for (Solution* referenceSol : referenceSols) {
+        std::set<std::string> fnNames = referenceSol->getFunctionNames();
+        neededFunctions.insert(fnNames.begin(), fnNames.end());
+    }
+
+    return neededFunctions;
+}
+
 //------------------------------------------------------------------------------
 // Registering Files
 //------------------------------------------------------------------------------
@@ -67,6 +245,10 @@ void Marker::setStudentFiles(std::vector<std::string> studentFiles, std::vector<
     this->studentSols = studentSols;
 }
 
+void Marker::setResultSink(ResultSink* resultSink) {
+    this->resultSink = resultSink;
+}
+
 void Marker::setReferenceFiles(std::vector<std::string> referenceFiles, std::vector<Solution*> referenceSols) {
     assert(this->referenceFiles.size() == 0);
     assert(this->referenceSols.size() == 0);
@@ -74,6 +256,16 @@ void Marker::setReferenceFiles(std::vector<std::string> referenceFiles, std::vec
 
     this->referenceFiles = referenceFiles;
     this->referenceSols = referenceSols;
+
+    // Pruned once here rather than in markAssignment() so that in batch mode
+    // every forked student process shares the already pruned references.
+    // References from the SolutionCache are already pruned.
+    std::set<std::string> interestingFunctions = getInterestingFunctions();
+    for (Solution* referenceSol : referenceSols) {
+        if (!referenceSol->isPruned()) {
+            referenceSol->pruneFunctions(interestingFunctions);
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -2,17 +2,33 @@
 
 #include <vector>
 #include "ast/Solution.h"
+#include "results/ResultSink.h"
 
 namespace clang {
 
 class Marker {
+    static const size_t SUBTREE_CACHE_BYTES = 256 * 1024 * 1024;
+    static const size_t STRATEGY_CACHE_BYTES = 128 * 1024 * 1024;
+    static const size_t MEMORY_BUDGET_BYTES = 1024 * 1024 * 1024; // Delta and tables past this go to temporary files
+    static const int COMPARISON_TIME_LIMIT_MS = 60 * 1000;           // Slower pairs get an approximate diff
+
     const std::string markerName;
 
+    // Shared by every comparison made by this marker
+    capted::SubtreeCache subtreeCache;
+    capted::StrategyCache strategyCache; // Submissions often share a function shape
+
+    ResultSink* resultSink = nullptr;
+
     void printHeader();
     void printFooter();
 
+    template <class Cost>
+    capted::EditDistanceResult computeDiff(capted::CostModel<SimpleStatement>* costModel, CaptedASTNode* studentFnAST, CaptedASTNode* referenceFnAST);
+
 protected:
     const std::map<std::string, std::vector<float>> keyFns;
+    const std::set<std::string> precompiledHeaders;
 
     std::vector<std::string> studentFiles;
     std::vector<std::string> referenceFiles;
@@ -20,7 +36,6 @@ protected:
     std::vector<Solution*> referenceSols;
 
     virtual void markAssignment() = 0;
-    std::set<std::string> getInterestingFunctions() const;
     void calculateASTDiff(CaptedASTNode* studentFnAST, CaptedASTNode* referenceFnAST, std::string studentFileName, std::string referenceFileName);
 
 public:
@@ -32,9 +47,45 @@ public:
     void setStudentFiles(std::vector<std::string> studentFiles, std::vector<Solution*> studentSols);
     void setReferenceFiles(std::vector<std::string> referenceFiles, std::vector<Solution*> referenceSols);
 
-    Marker(std::string markerName, const std::map<std::string, std::vector<float>> keyFns);
+    // Where calculateASTDiff() writes each comparison, not owned
+    void setResultSink(ResultSink* resultSink);
+
+    Marker(std::string markerName, const std::map<std::string, std::vector<float>> keyFns, const std::set<std::string> precompiledHeaders = {});
     virtual ~Marker();
     void run();
+
+    // Cache hit rates and sizes, to stderr
+    void printStats() const;
+
+    // Where the caches stood at some point, see exportCaches()
+    struct CacheMark {
+        long subtreeInsertions;
+        long subtreeHits;
+        long subtreeMisses;
+        long strategyInsertions;
+        long strategyHits;
+        long strategyMisses;
+    };
+
+    CacheMark getCacheMark() const;
+
+    // A forked child marks with a copy of the caches that is lost when it
+    // exits. exportCaches() gives the entries it added and the lookups it made
+    // since mark, which the parent passes to importCaches() so that the next
+    // child starts from them.
+    std::string exportCaches(const CacheMark &mark) const;
+    void importCaches(const std::string &exported);
+
+    // Pruning depends on these, see SolutionCache
+    std::set<std::string> getInterestingFunctions() const;
+    const std::map<std::string, std::vector<float>> &getKeyFns() const;
+
+    // System headers submissions are expected to include, see PrecompiledHeaders
+    const std::set<std::string> &getPrecompiledHeaders() const;
+
+    // Student functions to map up front, once the references are set. Any
+    // other is mapped when markAssignment() or the inliner reaches it.
+    virtual std::set<std::string> getNeededFunctions() const;
 };
 
 } // namespace clang
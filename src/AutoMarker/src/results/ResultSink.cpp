@@ -0,0 +1,359 @@
+#include "ResultSink.h"
+#include "Logger.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace clang;
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+static std::atomic<uint64_t> nextSinkId(0);
+
+// This thread's buffer for each sink it has written to, by sink id
+static thread_local std::vector<std::pair<uint64_t, void*>> threadBuffers;
+
+static void appendJsonString(std::string &out, const std::string &s) {
+    out += '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// Enough digits to read back as the same float
+static void appendJsonFloat(std::string &out, float f) {
+    char number[32];
+    snprintf(number, sizeof(number), "%.9g", f);
+    out += number;
+}
+
+template <typename T>
+static void appendLE(std::string &out, T value) {
+    typename std::conditional<sizeof(T) == 8, uint64_t, typename std::conditional<sizeof(T) == 4, uint32_t, uint8_t>::type>::type bits;
+    static_assert(sizeof(bits) == sizeof(T), "Unsupported column type");
+    memcpy(&bits, &value, sizeof(bits));
+
+    for (size_t i = 0; i < sizeof(bits); i++) {
+        out += (char) (bits >> (8 * i));
+    }
+}
+
+template <typename T>
+static void appendColumn(std::string &out, const std::vector<T> &column) {
+    for (const T &value : column) {
+        appendLE(out, value);
+    }
+}
+
+//------------------------------------------------------------------------------
+// ResultSink
+//------------------------------------------------------------------------------
+
+ResultSink* ResultSink::create(const std::string &format, const std::string &path) {
+    if (format == "text") {
+        return new TextResultSink();
+    }
+
+    if (path.empty()) {
+        Logger::abortError("Use -cam-results to give the file for " + format + " results");
+    }
+    if (format == "jsonl") {
+        return new JsonLinesResultSink(path);
+    } else if (format == "columnar") {
+        return new ColumnarResultSink(path);
+    }
+
+    Logger::abortError("Unknown result format: " + format);
+    return nullptr;
+}
+
+ResultSink::~ResultSink() {
+    // nop
+}
+
+//------------------------------------------------------------------------------
+// TextResultSink
+//------------------------------------------------------------------------------
+
+// The line goes to cout in one piece, so that lines from several threads
+// don't run into each other
+void TextResultSink::write(const DiffResult &result) {
+    std::ostringstream line;
+    line
+        << "stuFile:" << result.studentFile << " "
+        << "refFile:" << result.referenceFile << " "
+        << "stuFn:" << result.studentFn << " "
+        << "refFn:" << result.referenceFn << " "
+        << "diff:" << result.distance << " ";
+
+    // A pathological pair must not hold up the rest of the batch. Its diff is
+    // an upper bound, flagged after the fields that tests/util.py parses.
+    if (result.approximate) {
+        line << "approx:" << result.lowerBound << "-" << result.upperBound << " ";
+    }
+    line << "\n";
+
+    std::cout << line.str() << std::flush;
+}
+
+void TextResultSink::flush() {
+    std::cout.flush();
+}
+
+//------------------------------------------------------------------------------
+// BufferedResultSink
+//------------------------------------------------------------------------------
+
+BufferedResultSink::ThreadBuffer::~ThreadBuffer() {
+    // nop
+}
+
+BufferedResultSink::BufferedResultSink(const std::string &path)
+    : id(nextSinkId++)
+    , numBuffers(0) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        Logger::abortError("Cannot open results file " + path + ": " + strerror(errno));
+    }
+}
+
+BufferedResultSink::~BufferedResultSink() {
+    flush();
+    close(fd);
+}
+
+BufferedResultSink::ThreadBuffer* BufferedResultSink::getThreadBuffer() {
+    for (auto &it : threadBuffers) {
+        if (it.first == id) {
+            return static_cast<ThreadBuffer*>(it.second);
+        }
+    }
+
+    size_t slot = numBuffers++;
+    if (slot >= MAX_THREADS) {
+        Logger::abortError("Too many threads writing results");
+    }
+    buffers[slot].reset(newThreadBuffer());
+
+    threadBuffers.push_back(std::make_pair(id, (void*) buffers[slot].get()));
+    return buffers[slot].get();
+}
+
+// Appends to a regular file are atomic, so bytes from other threads and
+// processes land before or after these, never within
+void BufferedResultSink::writeOut(const std::string &bytes) {
+    size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t n = ::write(fd, bytes.data() + written, bytes.size() - written);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            Logger::abortError(std::string("Cannot write results: ") + strerror(errno));
+        }
+        written += n;
+    }
+}
+
+void BufferedResultSink::write(const DiffResult &result) {
+    ThreadBuffer* buffer = getThreadBuffer();
+    buffer->append(result);
+
+    if (buffer->isFull()) {
+        writeOut(buffer->take());
+    }
+}
+
+void BufferedResultSink::flush() {
+    size_t n = numBuffers.load();
+    n = n < MAX_THREADS ? n : MAX_THREADS;
+    for (size_t i = 0; i < n; i++) {
+        if (buffers[i]) {
+            std::string bytes = buffers[i]->take();
+            if (!bytes.empty()) {
+                writeOut(bytes);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Thread buffers
+//------------------------------------------------------------------------------
+
+namespace {
+
+class JsonLinesBuffer : public BufferedResultSink::ThreadBuffer {
+    static const size_t BUFFER_BYTES = 256 * 1024;
+
+    std::string lines;
+
+public:
+    void append(const DiffResult &result) override {
+        lines += "{\"stuFile\":";
+        appendJsonString(lines, result.studentFile);
+        lines += ",\"refFile\":";
+        appendJsonString(lines, result.referenceFile);
+        lines += ",\"stuFn\":";
+        appendJsonString(lines, result.studentFn);
+        lines += ",\"refFn\":";
+        appendJsonString(lines, result.referenceFn);
+        lines += ",\"diff\":";
+        appendJsonFloat(lines, result.distance);
+
+        if (result.approximate) {
+            lines += ",\"approx\":[";
+            appendJsonFloat(lines, result.lowerBound);
+            lines += ",";
+            appendJsonFloat(lines, result.upperBound);
+            lines += "]";
+        }
+        if (result.studentNodes >= 0) {
+            lines += ",\"stuNodes\":" + std::to_string(result.studentNodes);
+        }
+        if (result.referenceNodes >= 0) {
+            lines += ",\"refNodes\":" + std::to_string(result.referenceNodes);
+        }
+        if (result.micros >= 0) {
+            lines += ",\"micros\":" + std::to_string(result.micros);
+        }
+        lines += "}\n";
+    }
+
+    bool isFull() const override {
+        return lines.size() >= BUFFER_BYTES;
+    }
+
+    std::string take() override {
+        std::string bytes;
+        bytes.swap(lines);
+        return bytes;
+    }
+};
+
+class ColumnarBuffer : public BufferedResultSink::ThreadBuffer {
+    std::vector<std::string> strings;
+    std::map<std::string, uint32_t> stringIds;
+
+    std::vector<uint32_t> studentFile;
+    std::vector<uint32_t> referenceFile;
+    std::vector<uint32_t> studentFn;
+    std::vector<uint32_t> referenceFn;
+    std::vector<float> distance;
+    std::vector<float> lowerBound;
+    std::vector<float> upperBound;
+    std::vector<uint8_t> approximate;
+    std::vector<int32_t> studentNodes;
+    std::vector<int32_t> referenceNodes;
+    std::vector<int64_t> micros;
+
+    uint32_t getStringId(const std::string &s) {
+        auto it = stringIds.find(s);
+        if (it != stringIds.end()) {
+            return it->second;
+        }
+
+        uint32_t stringId = strings.size();
+        strings.push_back(s);
+        stringIds[s] = stringId;
+        return stringId;
+    }
+
+public:
+    void append(const DiffResult &result) override {
+        studentFile.push_back(getStringId(result.studentFile));
+        referenceFile.push_back(getStringId(result.referenceFile));
+        studentFn.push_back(getStringId(result.studentFn));
+        referenceFn.push_back(getStringId(result.referenceFn));
+        distance.push_back(result.distance);
+        lowerBound.push_back(result.lowerBound);
+        upperBound.push_back(result.upperBound);
+        approximate.push_back(result.approximate ? 1 : 0);
+        studentNodes.push_back(result.studentNodes);
+        referenceNodes.push_back(result.referenceNodes);
+        micros.push_back(result.micros);
+    }
+
+    bool isFull() const override {
+        return distance.size() >= ColumnarResultSink::BLOCK_ROWS;
+    }
+
+    std::string take() override {
+        std::string block;
+        if (distance.empty()) {
+            return block;
+        }
+
+        appendLE(block, ColumnarResultSink::MAGIC);
+        appendLE(block, ColumnarResultSink::VERSION);
+        appendLE(block, (uint32_t) distance.size());
+        appendLE(block, (uint32_t) strings.size());
+        for (const std::string &s : strings) {
+            appendLE(block, (uint32_t) s.size());
+            block += s;
+        }
+
+        appendColumn(block, studentFile);
+        appendColumn(block, referenceFile);
+        appendColumn(block, studentFn);
+        appendColumn(block, referenceFn);
+        appendColumn(block, distance);
+        appendColumn(block, lowerBound);
+        appendColumn(block, upperBound);
+        appendColumn(block, approximate);
+        appendColumn(block, studentNodes);
+        appendColumn(block, referenceNodes);
+        appendColumn(block, micros);
+
+        // Each block has its own strings, so it can be read on its own
+        *this = ColumnarBuffer();
+        return block;
+    }
+};
+
+} // namespace
+
+//------------------------------------------------------------------------------
+// JsonLinesResultSink
+//------------------------------------------------------------------------------
+
+JsonLinesResultSink::JsonLinesResultSink(const std::string &path) : BufferedResultSink(path) {
+    // nop
+}
+
+BufferedResultSink::ThreadBuffer* JsonLinesResultSink::newThreadBuffer() const {
+    return new JsonLinesBuffer();
+}
+
+//------------------------------------------------------------------------------
+// ColumnarResultSink
+//------------------------------------------------------------------------------
+
+ColumnarResultSink::ColumnarResultSink(const std::string &path) : BufferedResultSink(path) {
+    // nop
+}
+
+BufferedResultSink::ThreadBuffer* ColumnarResultSink::newThreadBuffer() const {
+    return new ColumnarBuffer();
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace clang {
+
+//------------------------------------------------------------------------------
+// Result Sinks
+//
+// Where Marker::calculateASTDiff() sends a row for each pair of functions it
+// compares. TextResultSink prints the stuFile:... lines that tests/util.py has
+// always parsed, in among the rest of stdout. The other sinks write a file of
+// rows alone:
+//
+// - jsonl, one object per line, keyed like the text fields
+// - columnar, binary blocks of rows stored column by column, see
+//   ColumnarResultSink
+//
+// For large courses, formatting the text and parsing it back takes a
+// noticeable share of a run.
+//
+// The file sinks buffer rows per thread. A full buffer is appended to the file,
+// which is opened with O_APPEND, in a single write(), so writing threads, and
+// forked children sharing the file, never take a lock or split a record.
+//------------------------------------------------------------------------------
+
+struct DiffResult {
+    std::string studentFile;
+    std::string referenceFile;
+    std::string studentFn;
+    std::string referenceFn;
+    float distance = 0;
+
+    // See capted::EditDistanceResult
+    bool approximate = false;
+    float lowerBound = 0;
+    float upperBound = 0;
+
+    // -1 when not measured
+    int32_t studentNodes = -1;
+    int32_t referenceNodes = -1;
+    int64_t micros = -1;
+};
+
+class ResultSink {
+public:
+    // format is text, jsonl or columnar. Aborts for any other, or a file that
+    // can't be opened. Text ignores path and goes to stdout.
+    static ResultSink* create(const std::string &format, const std::string &path);
+
+    virtual ~ResultSink();
+
+    // Safe to call from several threads
+    virtual void write(const DiffResult &result) = 0;
+
+    // Writes out every thread's buffered rows. Only call it while no thread is
+    // writing, e.g. after marking a student, and before fork() so that the
+    // child doesn't write the parent's rows again.
+    virtual void flush() = 0;
+};
+
+class TextResultSink : public ResultSink {
+public:
+    void write(const DiffResult &result) override;
+    void flush() override;
+};
+
+// Buffers rows per thread, see above. Subclasses decide what a thread's buffer
+// holds and how it is encoded.
+class BufferedResultSink : public ResultSink {
+    static const size_t MAX_THREADS = 256;
+
+    const uint64_t id; // Sinks are found by id from each thread, as addresses are reused
+    int fd;
+
+public:
+    class ThreadBuffer {
+    public:
+        virtual ~ThreadBuffer();
+        virtual void append(const DiffResult &result) = 0;
+        virtual bool isFull() const = 0;
+
+        // Encoded rows, or "" if there are none, leaving the buffer empty
+        virtual std::string take() = 0;
+    };
+
+private:
+    // Claimed by each thread on its first write
+    std::atomic<size_t> numBuffers;
+    std::unique_ptr<ThreadBuffer> buffers[MAX_THREADS];
+
+    ThreadBuffer* getThreadBuffer();
+    void writeOut(const std::string &bytes);
+
+protected:
+    virtual ThreadBuffer* newThreadBuffer() const = 0;
+
+public:
+    explicit BufferedResultSink(const std::string &path);
+    ~BufferedResultSink() override;
+
+    void write(const DiffResult &result) override;
+    void flush() override;
+};
+
+class JsonLinesResultSink : public BufferedResultSink {
+    ThreadBuffer* newThreadBuffer() const override;
+
+public:
+    explicit JsonLinesResultSink(const std::string &path);
+};
+
+// The file is a sequence of blocks, each written by one thread, of up to
+// BLOCK_ROWS rows. All values are little-endian.
+//
+//   u32 magic "CAMR", u32 version, u32 numRows, u32 numStrings
+//   numStrings x (u32 length, bytes)  file and function names, each once
+//   u32 studentFile[numRows]          indices into the strings above
+//   u32 referenceFile[numRows]
+//   u32 studentFn[numRows]
+//   u32 referenceFn[numRows]
+//   f32 distance[numRows]
+//   f32 lowerBound[numRows]
+//   f32 upperBound[numRows]
+//   u8  approximate[numRows]
+//   i32 studentNodes[numRows]
+//   i32 referenceNodes[numRows]
+//   i64 micros[numRows]
+//
+// tests/util.py reads it with numpy.
+class ColumnarResultSink : public BufferedResultSink {
+    ThreadBuffer* newThreadBuffer() const override;
+
+public:
+    static const uint32_t MAGIC = 0x524d4143; // "CAMR"
+    static const uint32_t VERSION = 1;
+    static const size_t BLOCK_ROWS = 4096;
+
+    explicit ColumnarResultSink(const std::string &path);
+};
+
+} // namespace clang
@@ -0,0 +1,393 @@
+#include "MarkingServer.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <ftw.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace clang;
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+static const int POLL_INTERVAL_MS = 100;
+
+static bool writeAll(int fd, const std::string &data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* buffer, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = read(fd, buffer + done, length - done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+static int removeEntry(const char* path, const struct stat* sb, int typeflag, struct FTW* ftwbuf) {
+    remove(path);
+    return 0;
+}
+
+static void removeTree(const std::string &path) {
+    nftw(path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// Relative, without any '..' component, so that it stays inside the scratch
+// directory
+static bool isSafeRelativePath(const std::string &path) {
+    if (path.empty() || path[0] == '/') {
+        return false;
+    }
+
+    std::stringstream ss(path);
+    std::string component;
+    while (std::getline(ss, component, '/')) {
+        if (component == "..") {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Ends the request in the child, whose stdout is the client by then
+static void abortRequest(const std::string &message) {
+    std::cout << "ERROR " << message << std::endl;
+    _exit(2);
+}
+
+//------------------------------------------------------------------------------
+// MarkingServer
+//------------------------------------------------------------------------------
+
+MarkingServer::MarkingServer(std::string socketPath, std::map<std::string, Marker*> markers, MarkFn markStudent, int maxWorkers, std::chrono::seconds timeLimit)
+    : socketPath(socketPath)
+    , markers(markers)
+    , markStudent(markStudent)
+    , maxWorkers(std::max(1, maxWorkers))
+    , timeLimit(timeLimit) {
+    const char* tmpDir = getenv("TMPDIR");
+    std::string path = std::string(tmpDir ? tmpDir : "/tmp") + "/cam-serve-XXXXXX";
+    std::vector<char> pathBuffer(path.begin(), path.end());
+    pathBuffer.push_back('\0');
+
+    if (!mkdtemp(pathBuffer.data())) {
+        Logger::abortError("Cannot create scratch directory " + path + ": " + strerror(errno));
+    }
+    scratchRoot = pathBuffer.data();
+}
+
+MarkingServer::~MarkingServer() {
+    if (listener != -1) {
+        close(listener);
+        unlink(socketPath.c_str());
+    }
+    removeTree(scratchRoot);
+}
+
+void MarkingServer::run() {
+    // A client that hangs up must not take the daemon down with it
+    signal(SIGPIPE, SIG_IGN);
+    listen();
+
+    std::cerr << "Serving on " << socketPath << " with " << maxWorkers << " workers" << std::endl;
+
+    while (true) {
+        reapWorkers();
+        killExpiredWorkers();
+
+        if (waitForEvents(POLL_INTERVAL_MS, (int)workers.size() < maxWorkers)) {
+            acceptRequest();
+        }
+    }
+}
+
+void MarkingServer::listen() {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        Logger::abortError("Socket path too long: " + socketPath);
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1) {
+        Logger::abortError(std::string("Cannot create socket: ") + strerror(errno));
+    }
+
+    // Left behind by a previous daemon that was killed
+    unlink(socketPath.c_str());
+
+    // FILE requests make the daemon read any path it can, so only its own
+    // user may connect. The umask covers the socket until it is chmod'ed.
+    mode_t umaskBefore = umask(0177);
+    int bound = bind(listener, (struct sockaddr*) &address, sizeof(address));
+    umask(umaskBefore);
+    if (bound == -1) {
+        Logger::abortError("Cannot bind " + socketPath + ": " + strerror(errno));
+    }
+    if (chmod(socketPath.c_str(), 0600) == -1) {
+        Logger::abortError("Cannot chmod " + socketPath + ": " + strerror(errno));
+    }
+    if (::listen(listener, SOMAXCONN) == -1) {
+        Logger::abortError("Cannot listen on " + socketPath + ": " + strerror(errno));
+    }
+}
+
+void MarkingServer::acceptRequest() {
+    int connection = accept(listener, nullptr, nullptr);
+    if (connection == -1) {
+        return;
+    }
+
+    std::string scratchDir = scratchRoot + "/" + std::to_string(requestCount++);
+
+    // Otherwise buffered output is written again by the child
+    std::cout.flush();
+    std::cerr.flush();
+
+    int cachePipe[2];
+    if (pipe(cachePipe) == -1) {
+        writeAll(connection, std::string("ERROR cannot create pipe: ") + strerror(errno) + "\n");
+        close(connection);
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        writeAll(connection, std::string("ERROR cannot fork: ") + strerror(errno) + "\n");
+        close(connection);
+        close(cachePipe[0]);
+        close(cachePipe[1]);
+        return;
+    }
+
+    if (pid == 0) {
+        close(cachePipe[0]);
+        handleRequest(connection, cachePipe[1], scratchDir);
+    }
+
+    close(cachePipe[1]);
+    workers.push_back({pid, connection, scratchDir, std::chrono::steady_clock::now() + timeLimit, false, cachePipe[0], ""});
+}
+
+void MarkingServer::reapWorkers() {
+    auto it = workers.begin();
+    while (it != workers.end()) {
+        int status;
+        if (waitpid(it->pid, &status, WNOHANG) != it->pid) {
+            it++;
+            continue;
+        }
+
+        // The child is gone, so this reaches the end of what it wrote
+        while (it->cachePipe != -1) {
+            waitForEvents(-1, false);
+        }
+
+        std::stringstream end;
+        if (it->timedOut) {
+            end << "END timeout";
+        } else if (WIFSIGNALED(status)) {
+            end << "END crashed " << WTERMSIG(status);
+        } else if (WEXITSTATUS(status) != 0) {
+            end << "END failed " << WEXITSTATUS(status);
+        } else {
+            end << "END ok";
+            importCacheExport(it->cacheExport);
+        }
+        end << "\n";
+
+        writeAll(it->connection, end.str());
+        close(it->connection);
+        removeTree(it->scratchDir);
+
+        it = workers.erase(it);
+    }
+}
+
+// Waits up to timeoutMs (forever if negative) for a request, if acceptRequests,
+// or for the children to write more of their cache exports, and reads what they
+// wrote. A child blocks once its pipe is full, so every wait includes them.
+//
+// Returns whether a request is waiting
+bool MarkingServer::waitForEvents(int timeoutMs, bool acceptRequests) {
+    std::vector<struct pollfd> pfds;
+    if (acceptRequests) {
+        pfds.push_back({listener, POLLIN, 0});
+    }
+    for (const Worker &worker : workers) {
+        if (worker.cachePipe != -1) {
+            pfds.push_back({worker.cachePipe, POLLIN, 0});
+        }
+    }
+
+    if (poll(pfds.data(), pfds.size(), timeoutMs) <= 0) {
+        return false;
+    }
+
+    for (Worker &worker : workers) {
+        auto pfd = std::find_if(pfds.begin(), pfds.end(), [&](const struct pollfd &p) { return p.fd == worker.cachePipe; });
+        if (pfd == pfds.end() || pfd->revents == 0) {
+            continue;
+        }
+
+        char buffer[64 * 1024];
+        ssize_t n = read(worker.cachePipe, buffer, sizeof(buffer));
+        if (n > 0) {
+            worker.cacheExport.append(buffer, n);
+        } else if (n == 0 || errno != EINTR) {
+            close(worker.cachePipe);
+            worker.cachePipe = -1;
+        }
+    }
+
+    return acceptRequests && pfds[0].revents != 0;
+}
+
+void MarkingServer::importCacheExport(const std::string &exported) {
+    size_t newline = exported.find('\n');
+    if (newline == std::string::npos) {
+        return; // Ended before it reached the marker
+    }
+
+    auto markerIt = markers.find(exported.substr(0, newline));
+    if (markerIt != markers.end()) {
+        markerIt->second->importCaches(exported.substr(newline + 1));
+    }
+}
+
+void MarkingServer::killExpiredWorkers() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    for (Worker &worker : workers) {
+        if (!worker.timedOut && now > worker.deadline) {
+            kill(worker.pid, SIGKILL);
+            worker.timedOut = true;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// Request (child)
+//------------------------------------------------------------------------------
+
+void MarkingServer::handleRequest(int connection, int cachePipe, const std::string &scratchDir) {
+    close(listener);
+
+    // Otherwise other clients don't see EOF until this request is done too
+    for (const Worker &worker : workers) {
+        close(worker.connection);
+        if (worker.cachePipe != -1) {
+            close(worker.cachePipe);
+        }
+    }
+    signal(SIGPIPE, SIG_DFL);
+
+    // Everything the marker prints goes to the client
+    dup2(connection, STDOUT_FILENO);
+
+    std::string header;
+    char c;
+    while (readAll(connection, &c, 1) && c != '\n') {
+        header += c;
+        if (header.size() > MAX_HEADER_LENGTH) {
+            abortRequest("header too long");
+        }
+    }
+
+    std::stringstream ss(header);
+    std::string command;
+    std::string markerName;
+    ss >> command >> markerName;
+
+    auto markerIt = markers.find(markerName);
+    if (markerIt == markers.end()) {
+        abortRequest("unknown marker '" + markerName + "'");
+    }
+
+    std::string studentFile;
+    if (command == "FILE") {
+        ss >> studentFile;
+    } else if (command == "SOURCE") {
+        std::string fileName;
+        long length = -1;
+        ss >> fileName >> length;
+        studentFile = readStudentSource(connection, scratchDir, fileName, length);
+    } else {
+        abortRequest("unknown command '" + command + "'");
+    }
+    close(connection);
+
+    if (studentFile.empty()) {
+        abortRequest("no student file");
+    }
+
+    Marker::CacheMark cacheMark = markerIt->second->getCacheMark();
+    markStudent(markerIt->second, studentFile);
+
+    std::cout.flush();
+    std::cerr.flush();
+    writeAll(cachePipe, markerName + "\n" + markerIt->second->exportCaches(cacheMark));
+    _exit(0);
+}
+
+// Written under the scratch directory, keeping the client's relative path since
+// the marker output (and tests/util.py) identify students by it
+std::string MarkingServer::readStudentSource(int connection, const std::string &scratchDir, const std::string &fileName, long length) {
+    if (!isSafeRelativePath(fileName)) {
+        abortRequest("file name must be a relative path: '" + fileName + "'");
+    }
+    if (length < 0 || length > MAX_SOURCE_LENGTH) {
+        abortRequest("bad source length");
+    }
+
+    std::vector<char> source(length);
+    if (!readAll(connection, source.data(), length)) {
+        abortRequest("source shorter than its length");
+    }
+
+    std::string path = scratchDir + "/" + fileName;
+    for (size_t slash = scratchDir.size(); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        mkdir(path.substr(0, slash).c_str(), 0700);
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file || fwrite(source.data(), 1, length, file) != (size_t)length || fclose(file) != 0) {
+        abortRequest("cannot write " + path + ": " + strerror(errno));
+    }
+
+    return path;
+}
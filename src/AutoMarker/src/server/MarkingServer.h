@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "markers/Marker.h"
+
+namespace clang {
+
+//------------------------------------------------------------------------------
+// Marking Server
+//
+// Long-lived daemon on a Unix domain socket. The markers are set up with their
+// parsed and pruned reference solutions once, at startup, and every request is
+// marked in a forked child that inherits them copy-on-write, the same way as a
+// batch run (see markStudentsInChildren() in main.cpp).
+//
+// One request per connection, a single header line followed by the student
+// source for SOURCE requests:
+//
+//   FILE <marker> <path>\n
+//   SOURCE <marker> <file name> <length>\n<length bytes>
+//
+// The marker output is streamed back as it is printed, followed by a final
+// line once the child is done:
+//
+//   END ok | END failed <exit code> | END crashed <signal> | END timeout
+//
+// The socket is only accessible to the daemon's own user.
+//
+// Each child sends the cache entries it added back over a pipe, prefixed by the
+// name of its marker, and the daemon keeps them if the request ends ok.
+//------------------------------------------------------------------------------
+
+class MarkingServer {
+public:
+    // Parses studentFile and runs marker on it, in the child
+    typedef std::function<void(Marker* marker, const std::string &studentFile)> MarkFn;
+
+private:
+    static const size_t MAX_HEADER_LENGTH = 4096;
+    static const long MAX_SOURCE_LENGTH = 16 * 1024 * 1024;
+
+    struct Worker {
+        pid_t pid;
+        int connection;
+        std::string scratchDir; // Removed once the child is done
+        std::chrono::steady_clock::time_point deadline;
+        bool timedOut;
+        int cachePipe;           // Read end, -1 once the child has closed it
+        std::string cacheExport; // See Marker::exportCaches()
+    };
+
+    const std::string socketPath;
+    const std::map<std::string, Marker*> markers;
+    const MarkFn markStudent;
+    const int maxWorkers;
+    const std::chrono::seconds timeLimit;
+
+    int listener = -1;
+    std::vector<Worker> workers;
+
+    // SOURCE requests are written to a directory per request under here
+    std::string scratchRoot;
+    long requestCount = 0;
+
+    void listen();
+    void acceptRequest();
+    void reapWorkers();
+    bool waitForEvents(int timeoutMs, bool acceptRequests);
+    void importCacheExport(const std::string &exported);
+    void killExpiredWorkers();
+
+    // Runs in the child and does not return
+    void handleRequest(int connection, int cachePipe, const std::string &scratchDir);
+    std::string readStudentSource(int connection, const std::string &scratchDir, const std::string &fileName, long length);
+
+public:
+    MarkingServer(std::string socketPath, std::map<std::string, Marker*> markers, MarkFn markStudent, int maxWorkers, std::chrono::seconds timeLimit);
+    ~MarkingServer();
+
+    // Never returns
+    void run();
+};
+
+} // namespace clang
@@ -0,0 +1,468 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <sys/resource.h>
+#include "Capted.h"
+#include "tests/TreeGenerator.h"
+
+using namespace capted;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+//------------------------------------------------------------------------------
+// Allocation tracking
+//------------------------------------------------------------------------------
+
+// Every allocation is prefixed with its size so that the live and peak heap
+// usage can be tracked in operator delete. The header keeps malloc's alignment.
+static const size_t ALLOC_HEADER = 16;
+
+static std::atomic<long> allocCount(0);
+static std::atomic<long> allocBytes(0);
+static std::atomic<long> liveBytes(0);
+static std::atomic<long> peakBytes(0);
+
+static void* trackedAlloc(size_t size) {
+    char* p = (char*) std::malloc(size + ALLOC_HEADER);
+    if (!p) {
+        return nullptr;
+    }
+
+    *(size_t*) p = size;
+    allocCount++;
+    allocBytes += size;
+
+    long live = (liveBytes += size);
+    long peak = peakBytes;
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live)) {
+        // retry
+    }
+
+    return p + ALLOC_HEADER;
+}
+
+static void trackedFree(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    char* p = (char*) ptr - ALLOC_HEADER;
+    liveBytes -= *(size_t*) p;
+    std::free(p);
+}
+
+void* operator new(size_t size) {
+    void* p = trackedAlloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t &) noexcept {
+    return trackedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return trackedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    trackedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    trackedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t &) noexcept {
+    trackedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t &) noexcept {
+    trackedFree(ptr);
+}
+
+//------------------------------------------------------------------------------
+// Shapes and algorithms
+//------------------------------------------------------------------------------
+
+typedef Node<StringNodeData> StringNode;
+
+struct Shape {
+    string name;
+    std::function<StringNode*(TreeGenerator &generator, int size)> generate;
+};
+
+static const std::vector<Shape> SHAPES = {
+    {"left-branch",  [](TreeGenerator &g, int size) { return g.leftBranchTree(size); }},
+    {"right-branch", [](TreeGenerator &g, int size) { return g.rightBranchTree(size); }},
+    {"zigzag",       [](TreeGenerator &g, int size) { return g.zigZagTree(size); }},
+    {"full-binary",  [](TreeGenerator &g, int size) { return g.fullBinaryTree(size); }},
+    {"random",       [](TreeGenerator &g, int size) { return g.randomTree(size); }},
+    {"ast",          [](TreeGenerator &g, int size) { return g.astTree(size); }},
+};
+
+struct RunResult {
+    float distance;
+    long subproblems;
+};
+
+struct Algorithm {
+    string name;
+    int maxSize; // Larger trees are skipped, 0 for no limit
+    std::function<RunResult(StringNode* t1, StringNode* t2)> run;
+};
+
+static const std::vector<Algorithm> ALGORITHMS = {
+    {"apted", 0, [](StringNode* t1, StringNode* t2) -> RunResult {
+        StringCostModel costModel;
+        Apted<StringNodeData> algorithm(&costModel);
+        float distance = algorithm.computeEditDistance(t1, t2);
+        return {distance, algorithm.getSubproblemCount()};
+    }},
+    {"apted-cache", 0, [](StringNode* t1, StringNode* t2) -> RunResult {
+        // Fresh cache, so only repeated subtree pairs within one computation hit
+        StringCostModel costModel;
+        SubtreeCache subtreeCache(64 * 1024 * 1024);
+        Apted<StringNodeData> algorithm(&costModel);
+        algorithm.setSubtreeCache(&subtreeCache);
+        float distance = algorithm.computeEditDistance(t1, t2);
+        return {distance, algorithm.getSubproblemCount()};
+    }},
+    {"apted-compact", 0, [](StringNode* t1, StringNode* t2) -> RunResult {
+        // spfA without the fn, ft and q arrays
+        StringCostModel costModel;
+        Apted<StringNodeData> algorithm(&costModel);
+        algorithm.setInnerPathArrays(false);
+        float distance = algorithm.computeEditDistance(t1, t2);
+        return {distance, algorithm.getSubproblemCount()};
+    }},
+    {"apted-int16", 16000, [](StringNode* t1, StringNode* t2) -> RunResult {
+        StringCostModel costModel;
+        Apted<StringNodeData, int16_t> algorithm(&costModel);
+        float distance = algorithm.computeEditDistance(t1, t2);
+        return {distance, algorithm.getSubproblemCount()};
+    }},
+    {"apted-int32", 0, [](StringNode* t1, StringNode* t2) -> RunResult {
+        StringCostModel costModel;
+        Apted<StringNodeData, int32_t> algorithm(&costModel);
+        float distance = algorithm.computeEditDistance(t1, t2);
+        return {distance, algorithm.getSubproblemCount()};
+    }},
+    {"all-mappings", 6, [](StringNode* t1, StringNode* t2) -> RunResult {
+        StringCostModel costModel;
+        AllPossibleMappings<StringNodeData> algorithm(&costModel);
+        return {algorithm.computeEditDistance(t1, t2), 0};
+    }},
+};
+
+//------------------------------------------------------------------------------
+// Metric index
+//------------------------------------------------------------------------------
+
+// One CSV row per query, comparing VPTree::knn to computing the distance to
+// every tree in the corpus. The corpus is clusters of small variations around
+// a few base trees, like submissions to the same assignment.
+static void benchMetricIndex(int corpusSize, unsigned int seed, int numLabels) {
+    const int numBases = 20;
+    const int numQueries = 20;
+    const int k = 5;
+
+    StringCostModel costModel;
+    TreeGenerator generator(seed, numLabels);
+
+    std::vector<StringNode*> bases;
+    for (int i = 0; i < numBases; i++) {
+        bases.push_back(generator.randomTree(30));
+    }
+
+    std::vector<StringNode*> nodes;
+    std::vector<PreparedTree<StringNodeData>*> corpus;
+    for (int i = 0; i < corpusSize; i++) {
+        nodes.push_back(generator.mutate(bases[i % numBases], i % 7));
+        corpus.push_back(new PreparedTree<StringNodeData>(nodes.back(), &costModel));
+    }
+
+    auto buildStart = std::chrono::steady_clock::now();
+    VPTree<StringNodeData> index(corpus, &costModel);
+    long buildNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - buildStart).count();
+
+    cerr << "build: " << buildNs << "ns, " << index.getDistanceCount() << " distances" << endl;
+    cout << "query,corpus,k,knn_ns,knn_distances,brute_ns,brute_distances" << endl;
+
+    for (int q = 0; q < numQueries; q++) {
+        StringNode* queryNode = generator.mutate(bases[q % numBases], 3);
+        PreparedTree<StringNodeData> query(queryNode, &costModel);
+
+        long before = index.getDistanceCount();
+        auto start = std::chrono::steady_clock::now();
+        index.knn(&query, k);
+        long knnNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        long knnDistances = index.getDistanceCount() - before;
+
+        start = std::chrono::steady_clock::now();
+        std::vector<float> distances;
+        for (PreparedTree<StringNodeData>* tree : corpus) {
+            Apted<StringNodeData> algorithm(&costModel);
+            distances.push_back(algorithm.computeEditDistance(&query, tree));
+        }
+        std::partial_sort(distances.begin(), distances.begin() + std::min(k, (int) distances.size()), distances.end());
+        long bruteNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+        cout << q << "," << corpus.size() << "," << k << ","
+             << knnNs << "," << knnDistances << ","
+             << bruteNs << "," << corpus.size() << endl;
+
+        delete queryNode;
+    }
+
+    for (PreparedTree<StringNodeData>* tree : corpus) {
+        delete tree;
+    }
+    for (StringNode* node : nodes) {
+        delete node;
+    }
+    for (StringNode* node : bases) {
+        delete node;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Similarity join
+//------------------------------------------------------------------------------
+
+// One CSV row comparing SimilarityJoin::selfJoin to computing the distance
+// between every pair of trees, on clusters of variations like those above
+static void benchSimilarityJoin(int numTrees, unsigned int seed, int numLabels) {
+    const int numBases = 30;
+    const float tau = 4.0f;
+
+    StringCostModel costModel;
+    TreeGenerator generator(seed, numLabels);
+
+    std::vector<StringNode*> bases;
+    for (int i = 0; i < numBases; i++) {
+        bases.push_back(generator.randomTree(20 + i));
+    }
+
+    std::vector<StringNode*> trees;
+    for (int i = 0; i < numTrees; i++) {
+        trees.push_back(generator.mutate(bases[i % numBases], i % 8));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    SimilarityJoin<StringNodeData> join(&costModel, tau);
+    join.selfJoin(trees);
+    long joinNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    long bruteMatches = 0;
+    for (int i = 0; i < numTrees; i++) {
+        for (int j = i + 1; j < numTrees; j++) {
+            Apted<StringNodeData> algorithm(&costModel);
+            bruteMatches += (algorithm.computeEditDistance(trees[i], trees[j]) <= tau);
+        }
+    }
+    long bruteNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    auto stats = join.getStats();
+    cout << "trees,tau,pairs,size_filtered,histogram_filtered,traversal_filtered,verified,matches,join_ns,brute_matches,brute_ns" << endl;
+    cout << numTrees << "," << tau << "," << stats.pairs << ","
+         << stats.sizeFiltered << "," << stats.histogramFiltered << "," << stats.traversalFiltered << ","
+         << stats.verified << "," << stats.matches << "," << joinNs << ","
+         << bruteMatches << "," << bruteNs << endl;
+
+    for (StringNode* node : trees) {
+        delete node;
+    }
+    for (StringNode* node : bases) {
+        delete node;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+struct Options {
+    std::vector<string> shapes;
+    std::vector<string> algorithms = {"apted"};
+    int minSize = 100;
+    int maxSize = 1000;
+    int stepSize = 100;
+    int repeat = 3;
+    int numLabels = 8;
+    unsigned int seed = 1;
+    int vptreeSize = 0; // Corpus size for the VP-tree comparison, 0 to skip it
+    int joinSize = 0;   // Corpus size for the similarity join comparison, 0 to skip it
+};
+
+static std::vector<string> splitList(const string &s) {
+    std::vector<string> items;
+    std::stringstream ss(s);
+    string item;
+    while (std::getline(ss, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+static void printUsage(const char* name) {
+    cerr << "Usage: " << name << " [options]" << endl;
+    cerr << "    --shapes=a,b,...      left-branch, right-branch, zigzag, full-binary, random, ast (default: all)" << endl;
+    cerr << "    --algorithms=a,b,...  apted, apted-cache, apted-compact, apted-int16, apted-int32, all-mappings (default: apted)" << endl;
+    cerr << "    --sizes=min:max:step  tree sizes (default: 100:1000:100)" << endl;
+    cerr << "    --repeat=n            runs per case (default: 3)" << endl;
+    cerr << "    --labels=n            distinct labels (default: 8)" << endl;
+    cerr << "    --seed=n              generator seed (default: 1)" << endl;
+    cerr << "    --vptree=n            compare VP-tree and brute force k-NN on a corpus of n trees instead" << endl;
+    cerr << "    --join=n              compare the similarity join and brute force on a corpus of n trees instead" << endl;
+}
+
+static bool parseOptions(int argc, char const *argv[], Options &options) {
+    for (const Shape &shape : SHAPES) {
+        options.shapes.push_back(shape.name);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq);
+        string value = (eq == string::npos) ? "" : arg.substr(eq + 1);
+
+        if (key == "--shapes") {
+            options.shapes = splitList(value);
+        } else if (key == "--algorithms") {
+            options.algorithms = splitList(value);
+        } else if (key == "--sizes") {
+            if (sscanf(value.c_str(), "%d:%d:%d", &options.minSize, &options.maxSize, &options.stepSize) != 3 || options.stepSize <= 0) {
+                return false;
+            }
+        } else if (key == "--repeat") {
+            options.repeat = std::max(1, atoi(value.c_str()));
+        } else if (key == "--labels") {
+            options.numLabels = std::max(1, std::min(26, atoi(value.c_str())));
+        } else if (key == "--seed") {
+            options.seed = strtoul(value.c_str(), nullptr, 10);
+        } else if (key == "--vptree") {
+            options.vptreeSize = std::max(1, atoi(value.c_str()));
+        } else if (key == "--join") {
+            options.joinSize = std::max(1, atoi(value.c_str()));
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<class T>
+static const T* findByName(const std::vector<T> &items, const string &name) {
+    for (const T &item : items) {
+        if (item.name == name) {
+            return &item;
+        }
+    }
+    return nullptr;
+}
+
+int main(int argc, char const *argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (options.vptreeSize > 0) {
+        benchMetricIndex(options.vptreeSize, options.seed, options.numLabels);
+        return 0;
+    }
+    if (options.joinSize > 0) {
+        benchSimilarityJoin(options.joinSize, options.seed, options.numLabels);
+        return 0;
+    }
+
+    // One CSV row per case. Times are in nanoseconds, allocations and peak
+    // heap are per run (all runs of a case behave the same), max_rss_kb is the
+    // process high-water mark so far.
+    cout << "shape,size1,size2,algorithm,distance,subproblems,time_min_ns,time_mean_ns,allocations,alloc_bytes,peak_heap_bytes,max_rss_kb" << endl;
+
+    for (const string &shapeName : options.shapes) {
+        const Shape* shape = findByName(SHAPES, shapeName);
+        if (!shape) {
+            cerr << "Unknown shape " << shapeName << endl;
+            return 1;
+        }
+
+        for (int size = options.minSize; size <= options.maxSize; size += options.stepSize) {
+            // Two draws from the generator: the same shape with different
+            // labels, except for random and ast, which give two different
+            // shapes of the same size
+            TreeGenerator generator(options.seed + size, options.numLabels);
+            StringNode* t1 = shape->generate(generator, size);
+            StringNode* t2 = shape->generate(generator, size);
+            int size1 = t1->getNodeCount();
+            int size2 = t2->getNodeCount();
+
+            for (const string &algorithmName : options.algorithms) {
+                const Algorithm* algorithm = findByName(ALGORITHMS, algorithmName);
+                if (!algorithm) {
+                    cerr << "Unknown algorithm " << algorithmName << endl;
+                    return 1;
+                }
+                if (algorithm->maxSize > 0 && size > algorithm->maxSize) {
+                    continue;
+                }
+
+                RunResult result;
+                long minNs = -1;
+                long totalNs = 0;
+                long allocations = 0;
+                long bytes = 0;
+                long peak = 0;
+
+                for (int r = 0; r < options.repeat; r++) {
+                    long countBefore = allocCount;
+                    long bytesBefore = allocBytes;
+                    peakBytes = liveBytes.load();
+                    long liveBefore = liveBytes;
+
+                    auto start = std::chrono::steady_clock::now();
+                    result = algorithm->run(t1, t2);
+                    long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+                    minNs = (minNs < 0) ? ns : std::min(minNs, ns);
+                    totalNs += ns;
+                    allocations = allocCount - countBefore;
+                    bytes = allocBytes - bytesBefore;
+                    peak = peakBytes - liveBefore;
+                }
+
+                struct rusage usage;
+                getrusage(RUSAGE_SELF, &usage);
+
+                cout << shape->name << "," << size1 << "," << size2 << "," << algorithm->name << ","
+                     << result.distance << "," << result.subproblems << ","
+                     << minNs << "," << (totalNs / options.repeat) << ","
+                     << allocations << "," << bytes << "," << peak << "," << usage.ru_maxrss << endl;
+            }
+
+            delete t1;
+            delete t2;
+        }
+    }
+}
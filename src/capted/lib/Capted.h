@@ -3,6 +3,10 @@
 #include "node/Node.h"
 #include "distance/AllPossibleMappings.h"
 #include "distance/Apted.h"
+#include "distance/StrategyCache.h"
+#include "distance/SubtreeCache.h"
+#include "index/SimilarityJoin.h"
+#include "index/VPTree.h"
 
 #include "CostModel.h"
 #include "InputParser.h"
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include "node/Node.h"
 
 namespace capted {
@@ -14,6 +15,48 @@ public:
     virtual float deleteCost(Node<Data>* n) const = 0;
     virtual float insertCost(Node<Data>* n) const = 0;
     virtual float renameCost(Node<Data>* n1, Node<Data>* n2) const = 0;
+
+    // True if the costs are non-negative, deletions and insertions cost the
+    // same, and rename costs are symmetric and satisfy the triangle
+    // inequality. The edit distance is then a metric and can be indexed by
+    // metric data structures such as VPTree.
+    virtual bool isMetric() const {
+        return false;
+    }
+
+    // True if deletions and insertions cost 1 and renames cost 0 between nodes
+    // with equal labelHash() and 1 otherwise. SimilarityJoin can then bound the
+    // edit distance from node counts, label histograms and traversal strings.
+    virtual bool isUnitCost() const {
+        return false;
+    }
+
+    // True if every cost is a whole number, so that Apted can compute with an
+    // integer Cost type.
+    virtual bool hasIntegerCosts() const {
+        return isUnitCost();
+    }
+
+    // Identical subtree detection (see NodeIndexer::preL_to_hash)
+    //
+    // A cost model opts in by returning true from hasZeroSelfRenameCost(). Its
+    // labelHash() must then make nodes with equal hashes interchangeable: same
+    // deletion/insertion costs, same rename cost against any third node, and a
+    // zero rename cost between each other.
+    virtual bool hasZeroSelfRenameCost() const {
+        return false;
+    }
+
+    virtual uint64_t labelHash(Node<Data>* n) const {
+        return 0;
+    }
+
+    // Cost models sharing a SubtreeCache must return distinct ids. Two
+    // instances configured identically should return the same id so that they
+    // can reuse each other's results.
+    virtual uint64_t getModelId() const {
+        return 0;
+    }
 };
 
 } // namespace capted
@@ -3,6 +3,7 @@
 #include <cassert>
 #include <iostream>
 #include <sstream>
+#include <functional>
 #include "InputParser.h"
 #include "CostModel.h"
 
@@ -19,7 +20,7 @@ private:
 public:
     friend std::ostream &operator<<(std::ostream &os, StringNodeData const &stringNode);
 
-    StringNodeData(std::string label) : label(label) { }
+    StringNodeData(std::string label) : label(std::move(label)) { }
     std::string getLabel() const { return label; }
 };
 
@@ -103,7 +104,7 @@ public:
         std::string rootLabel = getRootLabel(inputString);
         std::vector<std::string> childrenString = getChildrenString(inputString);
 
-        Node<StringNodeData>* node = new Node<StringNodeData>(new StringNodeData(rootLabel));
+        Node<StringNodeData>* node = new Node<StringNodeData>(StringNodeData(rootLabel));
         for (std::string childString : childrenString) {
             BracketStringInputParser parser(childString);
             node->addChild(parser.getRoot());
@@ -130,6 +131,26 @@ public:
     virtual float renameCost(Node<StringNodeData>* n1, Node<StringNodeData>* n2) const override {
         return (n1->getData()->getLabel() == n2->getData()->getLabel()) ? 0.0f : 1.0f;
     }
+
+    virtual bool isMetric() const override {
+        return true;
+    }
+
+    virtual bool isUnitCost() const override {
+        return true;
+    }
+
+    virtual bool hasZeroSelfRenameCost() const override {
+        return true;
+    }
+
+    virtual uint64_t labelHash(Node<StringNodeData>* n) const override {
+        return std::hash<std::string>()(n->getData()->getLabel());
+    }
+
+    virtual uint64_t getModelId() const override {
+        return std::hash<std::string>()("StringCostModel");
+    }
 };
 
 } // namespace capted
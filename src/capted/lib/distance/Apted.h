@@ -1,9 +1,18 @@
 #pragma once
 
+#include <chrono>
 #include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 #include <stack>
 #include "TreeEditDistance.h"
+#include "SubtreeCache.h"
+#include "StrategyCache.h"
+#include "DeltaMatrix.h"
+#include "AptedStats.h"
+#include "DistanceBounds.h"
 #include "util/debug.h"
 
 namespace capted {
@@ -30,24 +39,73 @@ static inline T signum(T val) {
     }
 }
 
+// Thrown by an Apted with an integer Cost type for a pair of trees whose
+// distances or strategy path IDs may not fit it
+class CostTypeOverflow : public std::overflow_error {
+public:
+    CostTypeOverflow(int size1, int size2)
+    : std::overflow_error("trees of " + std::to_string(size1) + " and " + std::to_string(size2) + " nodes are too large for the cost type") {
+        // nop
+    }
+};
+
 //------------------------------------------------------------------------------
 // Distance Algorithm (apted)
 //------------------------------------------------------------------------------
 
-template<class Data>
+// Cost is the type of the distances stored while computing, including the
+// delta matrix and the single-path function tables. For cost models with whole
+// number costs (CostModel::hasIntegerCosts()), int16_t halves the memory
+// traffic of float and int32_t that of double, as long as the trees are small
+// enough for the distances and strategy path IDs to fit. Pairs that might not
+// fit throw CostTypeOverflow before any work is done.
+template<class Data, class Cost = float>
 class Apted : public TreeEditDistance<Data> {
 private:
     static const int LEFT = 0;
     static const int RIGHT = 1;
     static const int INNER = 2;
 
-    std::vector<std::vector<float>> delta;
+    // A subtree pair on the gted work stack
+    struct GtedFrame {
+        int subtree1;
+        int subtree2;
+        bool expanded = false;     // Relevant subtrees pushed, solve next
+        bool saveToCache = false;
+        int pathID = -1;           // Strategy path, once expanded
+        int pathType = -1;
+        bool treesSwapped = false;
+
+        GtedFrame(int subtree1, int subtree2) : subtree1(subtree1), subtree2(subtree2) {
+            // nop
+        }
+    };
+
+    DeltaMatrix<Cost> delta;
+    std::vector<GtedFrame> gtedStack;
 
-    std::vector<float> q;
+    std::vector<Cost> q;
     std::vector<int> fn;
     std::vector<int> ft;
     long counter = 0;
 
+    SubtreeCache* subtreeCache = nullptr;
+    StrategyCache* strategyCache = nullptr;
+    AptedStats* stats = nullptr;
+    size_t memoryBudget = std::numeric_limits<size_t>::max();
+    BudgetPolicy budgetPolicy = BudgetPolicy::FILE_BACKED;
+
+    // See setSubproblemBudget() and setTimeBudget()
+    float subproblemBudget = std::numeric_limits<float>::infinity();
+    bool hasTimeBudget = false;
+    std::chrono::steady_clock::duration timeBudget;
+    std::chrono::steady_clock::time_point deadline;
+    float predictedSubproblems = 0;
+    bool stopped = false;
+
+    // See setInnerPathArrays()
+    bool innerPathArrays = true;
+
     void updateFnArray(int lnForNode, int node, int currentSubtreePreL) {
         if (lnForNode >= currentSubtreePreL) {
             fn[node] = fn[lnForNode];
@@ -79,9 +137,40 @@ private:
         return INNER;
     }
 
+    // Without the fn and ft arrays [1, Section 8.4], the nodes of the current
+    // forest in G are found from the two preorders. In the left part of spfA
+    // they are the nodes with a right-to-left preorder id of at least rG. Going
+    // through them in decreasing left-to-right preorder only has to skip the
+    // ancestors of rG, which only appear between lGlast and lGfirst for inner
+    // paths. The right part is the same with both preorders swapped.
+    //
+    // toOther maps ids in the order being walked to the other order, and
+    // otherFirst is the forest boundary in the other order (rG or lG).
+
+    // The node of the forest before node, or a node before last if none
+    static int prevInForest(const std::vector<int> &toOther, int node, int otherFirst, int last) {
+        do {
+            node--;
+        } while (node >= last && toOther[node] < otherFirst);
+        return node;
+    }
+
+    // The first node of the forest at or after node
+    static int firstInForest(const std::vector<int> &toOther, int node, int otherFirst) {
+        while (toOther[node] < otherFirst) {
+            node++;
+        }
+        return node;
+    }
+
     //--------------------------------------------------------------------------
 
-    float spfA(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, int pathID, int pathType, bool treesSwapped) {
+    // UseFnFt selects the original implementation that keeps the current
+    // forest in G as the linked lists fn and ft, and the distances to forests
+    // without their root in q. Both give the same results; see
+    // setInnerPathArrays().
+    template<bool UseFnFt>
+    Cost spfA(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, int pathID, int pathType, bool treesSwapped) {
         std::vector<Node<Data>*> &it2nodes = it2->preL_to_node;
         Node<Data>* lFNode;
         std::vector<int> &it1sizes = it1->sizes;
@@ -101,28 +190,24 @@ private:
         int tmpForestSize1 = 0;
 
         // Variables to incrementally sum up the forest cost.
-        float currentForestCost1 = 0;
-        float currentForestCost2 = 0;
-        float tmpForestCost1 = 0;
+        Cost currentForestCost1 = 0;
+        Cost currentForestCost2 = 0;
+        Cost tmpForestCost1 = 0;
 
         int subtreeSize2 = it2->sizes[currentSubtreePreL2];
         int subtreeSize1 = it1->sizes[currentSubtreePreL1];
-        std::vector<std::vector<float>> t(subtreeSize2 + 1);
-        for (size_t i = 0; i < t.size(); i++) {
-            t[i].resize(subtreeSize2 + 1);
-        }
-        std::vector<std::vector<float>> s(subtreeSize1 + 1);
-        for (size_t i = 0; i < s.size(); i++) {
-            s[i].resize(subtreeSize2 + 1);
-        }
+        DeltaMatrix<Cost> t;
+        DeltaMatrix<Cost> s;
+        allocateTable(t, subtreeSize2 + 1, subtreeSize2 + 1, 0);
+        allocateTable(s, subtreeSize1 + 1, subtreeSize2 + 1, t.getHeapBytes());
 
-        float minCost = -1;
+        Cost minCost = -1;
 
         // sp1, sp2 and sp3 correspond to three elements of the minimum in the
         // recursive formula [1, Figure 12].
-        float sp1 = 0;
-        float sp2 = 0;
-        float sp3 = 0;
+        Cost sp1 = 0;
+        Cost sp2 = 0;
+        Cost sp3 = 0;
         int startPathNode = -1;
         int endPathNode = pathID;
         int it1PreLoff = endPathNode;
@@ -137,13 +222,13 @@ private:
 
         bool leftPart,rightPart,fForestIsTree,lFIsConsecutiveNodeOfCurrentPathNode,lFIsLeftSiblingOfCurrentPathNode,
         rFIsConsecutiveNodeOfCurrentPathNode,rFIsRightSiblingOfCurrentPathNode;
-        std::vector<float>* sp1spointer;
-        std::vector<float>* sp2spointer;
-        std::vector<float>* sp3spointer;
-        std::vector<float>* sp3deltapointer;
-        std::vector<float>* swritepointer;
-        std::vector<float>* sp1tpointer;
-        std::vector<float>* sp3tpointer;
+        Cost* sp1spointer;
+        Cost* sp2spointer;
+        Cost* sp3spointer;
+        Cost* sp3deltapointer;
+        Cost* swritepointer;
+        Cost* sp1tpointer;
+        Cost* sp3tpointer;
 
         // These variables store the id of the source (which array) of looking up
         // elements of the minimum in the recursive formula [1, Figures 12,13].
@@ -189,11 +274,14 @@ private:
                 rGlast = it2preL_to_preR[currentSubtreePreL2];
                 rGfirst = (rGlast + subtreeSize2) - 1;
                 lFlast = rightPart ? endPathNode + 1 : endPathNode;
-                fn[fn.size() - 1] = -1;
 
-                for (int i = currentSubtreePreL2; i < currentSubtreePreL2 + subtreeSize2; i++) {
-                    fn[i] = -1;
-                    ft[i] = -1;
+                if (UseFnFt) {
+                    fn[fn.size() - 1] = -1;
+
+                    for (int i = currentSubtreePreL2; i < currentSubtreePreL2 + subtreeSize2; i++) {
+                        fn[i] = -1;
+                        ft[i] = -1;
+                    }
                 }
 
                 // Store the current size and cost of forest in F.
@@ -217,8 +305,10 @@ private:
                         lGlast = lGfirst == currentSubtreePreL2 ? lGfirst : currentSubtreePreL2+1;
                     }
 
-                    updateFnArray(it2->preL_to_ln[lGfirst], lGfirst, currentSubtreePreL2);
-                    updateFtArray(it2->preL_to_ln[lGfirst], lGfirst);
+                    if (UseFnFt) {
+                        updateFnArray(it2->preL_to_ln[lGfirst], lGfirst, currentSubtreePreL2);
+                        updateFtArray(it2->preL_to_ln[lGfirst], lGfirst);
+                    }
                     int rF = rFfirst;
 
                     // Reset size and cost of the forest in F.
@@ -244,11 +334,11 @@ private:
                         lFSubtreeSize = it1sizes[lF];
                         lFIsConsecutiveNodeOfCurrentPathNode = startPathNode - lF == 1;
                         lFIsLeftSiblingOfCurrentPathNode = lF + lFSubtreeSize == startPathNode;
-                        sp1spointer = &(s[(lF + 1) - it1PreLoff]);
-                        sp2spointer = &(s[lF - it1PreLoff]);
-                        sp3spointer = &(s[0]);
-                        sp3deltapointer = treesSwapped ? nullptr : &(delta[lF]);
-                        swritepointer = &(s[lF - it1PreLoff]);
+                        sp1spointer = s[(lF + 1) - it1PreLoff];
+                        sp2spointer = s[lF - it1PreLoff];
+                        sp3spointer = s[0];
+                        sp3deltapointer = treesSwapped ? nullptr : delta[lF];
+                        swritepointer = s[lF - it1PreLoff];
                         sp1source = 1; // Search sp1 value in s array by default.
                         sp3source = 1; // Search second part of sp3 value in s array by default.
 
@@ -273,7 +363,7 @@ private:
                         }
 
                         if (sp3source == 1) {
-                            sp3spointer = &(s[(lF + lFSubtreeSize) - it1PreLoff]);
+                            sp3spointer = s[(lF + lFSubtreeSize) - it1PreLoff];
                         }
 
                         // Go to first lG.
@@ -283,7 +373,7 @@ private:
                         // sp1, sp2, sp3 -- Done here for the first node in Loop D. It differs for consecutive nodes.
                         // sp1 -- START
                         switch(sp1source) {
-                            case 1: sp1 = (*sp1spointer)[lG - it2PreLoff]; break;
+                            case 1: sp1 = sp1spointer[lG - it2PreLoff]; break;
                             case 2: sp1 = t[lG - it2PreLoff][rG - it2PreRoff]; break;
                             case 3: sp1 = currentForestCost2; break; // USE COST MODEL - Insert G_{lG,rG}.
                         }
@@ -294,8 +384,12 @@ private:
                         // sp2 -- START
                         if (currentForestSize2 == 1) { // G_{lG,rG} is a single node.
                             sp2 = currentForestCost1; // USE COST MODEL - Delete F_{lF,rF}.
-                        } else { // G_{lG,rG} is a tree.
+                        } else if (UseFnFt) { // G_{lG,rG} is a tree.
                             sp2 = q[lF];
+                        } else {
+                            // Still holds the distance to G_{lG,rG}-lG from the
+                            // previous iteration of Loop B.
+                            sp2 = s[lF - it1PreLoff][(lGfirst + 1) - it2PreLoff];
                         }
                         sp2 += (treesSwapped ? this->costModel->deleteCost(it2nodes[lG]) : this->costModel->insertCost(it2nodes[lG]));// USE COST MODEL - Insert lG, leftmost root node in G_{lG,rG}.
                         if (sp2 < minCost) { // Check if sp2 is minimal value.
@@ -305,7 +399,7 @@ private:
 
                         // sp3 -- START
                         if (sp3 < minCost) {
-                            sp3 += treesSwapped ? delta[lG][lF] : (*sp3deltapointer)[lG];
+                            sp3 += treesSwapped ? delta[lG][lF] : sp3deltapointer[lG];
                             if (sp3 < minCost) {
                                 sp3 += (treesSwapped ? this->costModel->renameCost(it2nodes[lG], lFNode) : this->costModel->renameCost(lFNode, it2nodes[lG])); // USE COST MODEL - Rename the leftmost root nodes in F_{lF,rF} and G_{lG,rG}.
                                 if(sp3 < minCost) {
@@ -315,10 +409,11 @@ private:
                         }
                         // sp3 -- END
 
-                        (*swritepointer)[lG - it2PreLoff] = minCost;
+                        swritepointer[lG - it2PreLoff] = minCost;
 
                         // Go to next lG.
-                        lG = ft[lG];
+                        int lGnext = lG;
+                        lG = UseFnFt ? ft[lG] : prevInForest(it2preL_to_preR, lG, rG, lGlast);
                         counter++;
 
                         // Loop D [1, Algorithm 3] - for all nodes to the left of rG.
@@ -327,23 +422,23 @@ private:
                             currentForestSize2++;
                             currentForestCost2 += (treesSwapped ? this->costModel->deleteCost(it2nodes[lG]) : this->costModel->insertCost(it2nodes[lG]));
                             switch(sp1source) {
-                                case 1: sp1 = (*sp1spointer)[lG - it2PreLoff] + (treesSwapped ? this->costModel->insertCost(lFNode) : this->costModel->deleteCost(lFNode)); break; // USE COST MODEL - Delete lF, leftmost root node in F_{lF,rF}.
+                                case 1: sp1 = sp1spointer[lG - it2PreLoff] + (treesSwapped ? this->costModel->insertCost(lFNode) : this->costModel->deleteCost(lFNode)); break; // USE COST MODEL - Delete lF, leftmost root node in F_{lF,rF}.
                                 case 2: sp1 = t[lG - it2PreLoff][rG - it2PreRoff] + (treesSwapped ? this->costModel->insertCost(lFNode) : this->costModel->deleteCost(lFNode)); break; // USE COST MODEL - Delete lF, leftmost root node in F_{lF,rF}.
                                 case 3: sp1 = currentForestCost2 + (treesSwapped ? this->costModel->insertCost(lFNode) : this->costModel->deleteCost(lFNode)); break; // USE COST MODEL - Insert G_{lG,rG} and elete lF, leftmost root node in F_{lF,rF}.
                             }
 
-                            sp2 = (*sp2spointer)[fn[lG] - it2PreLoff] + (treesSwapped ? this->costModel->deleteCost(it2nodes[lG]) : this->costModel->insertCost(it2nodes[lG])); // USE COST MODEL - Insert lG, leftmost root node in G_{lG,rG}.
+                            sp2 = sp2spointer[(UseFnFt ? fn[lG] : lGnext) - it2PreLoff] + (treesSwapped ? this->costModel->deleteCost(it2nodes[lG]) : this->costModel->insertCost(it2nodes[lG])); // USE COST MODEL - Insert lG, leftmost root node in G_{lG,rG}.
                             minCost = sp1;
                             if(sp2 < minCost) {
                                 minCost = sp2;
                             }
 
-                            sp3 = treesSwapped ? delta[lG][lF] : (*sp3deltapointer)[lG];
+                            sp3 = treesSwapped ? delta[lG][lF] : sp3deltapointer[lG];
                             if (sp3 < minCost) {
                                 switch(sp3source) {
-                                    case 1: sp3 += (*sp3spointer)[fn[(lG + it2sizes[lG]) - 1] - it2PreLoff]; break;
+                                    case 1: sp3 += sp3spointer[(UseFnFt ? fn[(lG + it2sizes[lG]) - 1] : firstInForest(it2preL_to_preR, lG + it2sizes[lG], rG)) - it2PreLoff]; break;
                                     case 2: sp3 += currentForestCost2 - (treesSwapped ? it2->preL_to_sumDelCost[lG] : it2->preL_to_sumInsCost[lG]); break; // USE COST MODEL - Insert G_{lG,rG}-G_lG.
-                                    case 3: sp3 += t[fn[(lG + it2sizes[lG]) - 1] - it2PreLoff][rG - it2PreRoff]; break;
+                                    case 3: sp3 += t[(UseFnFt ? fn[(lG + it2sizes[lG]) - 1] : firstInForest(it2preL_to_preR, lG + it2sizes[lG], rG)) - it2PreLoff][rG - it2PreRoff]; break;
                                 }
 
                                 if (sp3 < minCost) {
@@ -353,8 +448,9 @@ private:
                                     }
                                 }
                             }
-                            (*swritepointer)[lG - it2PreLoff] = minCost;
-                            lG = ft[lG];
+                            swritepointer[lG - it2PreLoff] = minCost;
+                            lGnext = lG;
+                            lG = UseFnFt ? ft[lG] : prevInForest(it2preL_to_preR, lG, rG, lGlast);
                             counter++;
                         }
                     }
@@ -377,13 +473,15 @@ private:
                             }
                         }
 
-                        for (int lF = lFfirst; lF >= lFlast; lF--) {
-                            q[lF] = s[lF - it1PreLoff][(parent_of_rG_in_preL + 1) - it2PreLoff];
+                        if (UseFnFt) {
+                            for (int lF = lFfirst; lF >= lFlast; lF--) {
+                                q[lF] = s[lF - it1PreLoff][(parent_of_rG_in_preL + 1) - it2PreLoff];
+                            }
                         }
                     }
 
                     // TODO: first pointers can be precomputed
-                    for (int lG = lGfirst; lG >= lGlast; lG = ft[lG]) {
+                    for (int lG = lGfirst; lG >= lGlast; lG = UseFnFt ? ft[lG] : prevInForest(it2preL_to_preR, lG, rG, lGlast)) {
                         t[lG - it2PreLoff][rG - it2PreRoff] = s[lFlast - it1PreLoff][lG - it2PreLoff];
                     }
                 }
@@ -403,11 +501,14 @@ private:
                 lGlast = currentSubtreePreL2;
                 lGfirst = (lGlast + subtreeSize2) - 1;
                 rFlast = it1preL_to_preR[endPathNode];
-                fn[fn.size() - 1] = -1;
 
-                for (int i = currentSubtreePreL2; i < currentSubtreePreL2 + subtreeSize2; i++){
-                    fn[i] = -1;
-                    ft[i] = -1;
+                if (UseFnFt) {
+                    fn[fn.size() - 1] = -1;
+
+                    for (int i = currentSubtreePreL2; i < currentSubtreePreL2 + subtreeSize2; i++){
+                        fn[i] = -1;
+                        ft[i] = -1;
+                    }
                 }
 
                 // Store size and cost of the current forest in F.
@@ -417,8 +518,10 @@ private:
                 // Loop B' [1, Algorithm 3] - for all nodes in G.
                 for (int lG = lGfirst; lG >= lGlast; lG--) {
                     rGfirst = it2preL_to_preR[lG];
-                    updateFnArray(it2->preR_to_ln[rGfirst], rGfirst, it2preL_to_preR[currentSubtreePreL2]);
-                    updateFtArray(it2->preR_to_ln[rGfirst], rGfirst);
+                    if (UseFnFt) {
+                        updateFnArray(it2->preR_to_ln[rGfirst], rGfirst, it2preL_to_preR[currentSubtreePreL2]);
+                        updateFtArray(it2->preR_to_ln[rGfirst], rGfirst);
+                    }
                     int lF = lFfirst;
                     lGminus1_in_preR = lG <= currentSubtreePreL2 ? 0x7fffffff : it2preL_to_preR[lG - 1];
                     parent_of_lG = it2parents[lG];
@@ -466,13 +569,13 @@ private:
 
                         fForestIsTree = rF_in_preL == lF;
                         Node<Data>* rFNode = it1->preL_to_node[rF_in_preL];
-                        sp1spointer = &(s[(rF + 1) - it1PreRoff]);
-                        sp2spointer = &(s[rF - it1PreRoff]);
-                        sp3spointer = &(s[0]);
-                        sp3deltapointer = treesSwapped ? nullptr : &(delta[rF_in_preL]);
-                        swritepointer = &(s[rF - it1PreRoff]);
-                        sp1tpointer = &(t[lG - it2PreLoff]);
-                        sp3tpointer = &(t[lG - it2PreLoff]);
+                        sp1spointer = s[(rF + 1) - it1PreRoff];
+                        sp2spointer = s[rF - it1PreRoff];
+                        sp3spointer = s[0];
+                        sp3deltapointer = treesSwapped ? nullptr : delta[rF_in_preL];
+                        swritepointer = s[rF - it1PreRoff];
+                        sp1tpointer = t[lG - it2PreLoff];
+                        sp3tpointer = t[lG - it2PreLoff];
                         sp1source = 1;
                         sp3source = 1;
 
@@ -495,13 +598,17 @@ private:
                         }
 
                         if (sp3source == 1) {
-                            sp3spointer = &(s[(rF + rFSubtreeSize) - it1PreRoff]);
+                            sp3spointer = s[(rF + rFSubtreeSize) - it1PreRoff];
                         }
 
                         if (currentForestSize2 == 1) {
                             sp2 = currentForestCost1;// USE COST MODEL - Delete F_{lF,rF}.
-                        } else {
+                        } else if (UseFnFt) {
                             sp2 = q[rF];
+                        } else {
+                            // Still holds the distance to G_{lG,rG}-rG from the
+                            // previous iteration of Loop B'.
+                            sp2 = s[rF - it1PreRoff][(rGfirst + 1) - it2PreRoff];
                         }
 
                         int rG = rGfirst;
@@ -509,8 +616,8 @@ private:
                         currentForestSize2++;
 
                         switch (sp1source) {
-                            case 1: sp1 = (*sp1spointer)[rG - it2PreRoff]; break;
-                            case 2: sp1 = (*sp1tpointer)[rG - it2PreRoff]; break;
+                            case 1: sp1 = sp1spointer[rG - it2PreRoff]; break;
+                            case 2: sp1 = sp1tpointer[rG - it2PreRoff]; break;
                             case 3: sp1 = currentForestCost2; break; // USE COST MODEL - Insert G_{lG,rG}.
                         }
 
@@ -523,7 +630,7 @@ private:
                         }
 
                         if (sp3 < minCost) {
-                            sp3 += treesSwapped ? delta[rGfirst_in_preL][rF_in_preL] : (*sp3deltapointer)[rGfirst_in_preL];
+                            sp3 += treesSwapped ? delta[rGfirst_in_preL][rF_in_preL] : sp3deltapointer[rGfirst_in_preL];
                             if (sp3 < minCost) {
                                 sp3 += (treesSwapped ? this->costModel->renameCost(it2nodes[rGfirst_in_preL], rFNode) : this->costModel->renameCost(rFNode, it2nodes[rGfirst_in_preL]));
                                 if (sp3 < minCost) {
@@ -532,8 +639,9 @@ private:
                             }
                         }
 
-                        (*swritepointer)[rG - it2PreRoff] = minCost;
-                        rG = ft[rG];
+                        swritepointer[rG - it2PreRoff] = minCost;
+                        int rGnext = rG;
+                        rG = UseFnFt ? ft[rG] : prevInForest(it2preR_to_preL, rG, lG, rGlast);
                         counter++;
 
                         // Loop D' [1, Algorithm 3] - for all nodes to the right of lG;
@@ -543,21 +651,21 @@ private:
                             currentForestSize2++;
                             currentForestCost2 += (treesSwapped ? this->costModel->deleteCost(it2nodes[rG_in_preL]) : this->costModel->insertCost(it2nodes[rG_in_preL]));
                             switch (sp1source) {
-                                case 1: sp1 = (*sp1spointer)[rG - it2PreRoff] + (treesSwapped ? this->costModel->insertCost(rFNode) : this->costModel->deleteCost(rFNode)); break; // USE COST MODEL - Delete rF.
-                                case 2: sp1 = (*sp1tpointer)[rG - it2PreRoff] + (treesSwapped ? this->costModel->insertCost(rFNode) : this->costModel->deleteCost(rFNode)); break; // USE COST MODEL - Delete rF.
+                                case 1: sp1 = sp1spointer[rG - it2PreRoff] + (treesSwapped ? this->costModel->insertCost(rFNode) : this->costModel->deleteCost(rFNode)); break; // USE COST MODEL - Delete rF.
+                                case 2: sp1 = sp1tpointer[rG - it2PreRoff] + (treesSwapped ? this->costModel->insertCost(rFNode) : this->costModel->deleteCost(rFNode)); break; // USE COST MODEL - Delete rF.
                                 case 3: sp1 = currentForestCost2 + (treesSwapped ? this->costModel->insertCost(rFNode) : this->costModel->deleteCost(rFNode)); break; // USE COST MODEL - Insert G_{lG,rG} and delete rF.
                             }
-                            sp2 = (*sp2spointer)[fn[rG] - it2PreRoff] + (treesSwapped ? this->costModel->deleteCost(it2nodes[rG_in_preL]) : this->costModel->insertCost(it2nodes[rG_in_preL])); // USE COST MODEL - Insert rG.
+                            sp2 = sp2spointer[(UseFnFt ? fn[rG] : rGnext) - it2PreRoff] + (treesSwapped ? this->costModel->deleteCost(it2nodes[rG_in_preL]) : this->costModel->insertCost(it2nodes[rG_in_preL])); // USE COST MODEL - Insert rG.
                             minCost = sp1;
                             if (sp2 < minCost) {
                                 minCost = sp2;
                             }
-                            sp3 = treesSwapped ? delta[rG_in_preL][rF_in_preL] : (*sp3deltapointer)[rG_in_preL];
+                            sp3 = treesSwapped ? delta[rG_in_preL][rF_in_preL] : sp3deltapointer[rG_in_preL];
                             if (sp3 < minCost) {
                                 switch (sp3source) {
-                                    case 1: sp3 += (*sp3spointer)[fn[(rG + it2sizes[rG_in_preL]) - 1] - it2PreRoff]; break;
+                                    case 1: sp3 += sp3spointer[(UseFnFt ? fn[(rG + it2sizes[rG_in_preL]) - 1] : firstInForest(it2preR_to_preL, rG + it2sizes[rG_in_preL], lG)) - it2PreRoff]; break;
                                     case 2: sp3 += currentForestCost2 - (treesSwapped ? it2->preL_to_sumDelCost[rG_in_preL] : it2->preL_to_sumInsCost[rG_in_preL]); break; // USE COST MODEL - Insert G_{lG,rG}-G_rG.
-                                    case 3: sp3 += (*sp3tpointer)[fn[(rG + it2sizes[rG_in_preL]) - 1] - it2PreRoff]; break;
+                                    case 3: sp3 += sp3tpointer[(UseFnFt ? fn[(rG + it2sizes[rG_in_preL]) - 1] : firstInForest(it2preR_to_preL, rG + it2sizes[rG_in_preL], lG)) - it2PreRoff]; break;
                                 }
                                 if (sp3 < minCost) {
                                     sp3 += (treesSwapped ? this->costModel->renameCost(it2nodes[rG_in_preL], rFNode) : this->costModel->renameCost(rFNode, it2nodes[rG_in_preL])); // USE COST MODEL - Rename rF to rG.
@@ -566,8 +674,9 @@ private:
                                     }
                                 }
                             }
-                            (*swritepointer)[rG - it2PreRoff] = minCost;
-                            rG = ft[rG];
+                            swritepointer[rG - it2PreRoff] = minCost;
+                            rGnext = rG;
+                            rG = UseFnFt ? ft[rG] : prevInForest(it2preR_to_preL, rG, lG, rGlast);
                             counter++;
                         }
                     }
@@ -589,13 +698,15 @@ private:
                             }
                         }
 
-                        for (int rF = rFfirst; rF >= rFlast; rF--) {
-                            q[rF] = s[rF - it1PreRoff][(parent_of_lG_in_preR + 1) - it2PreRoff];
+                        if (UseFnFt) {
+                            for (int rF = rFfirst; rF >= rFlast; rF--) {
+                                q[rF] = s[rF - it1PreRoff][(parent_of_lG_in_preR + 1) - it2PreRoff];
+                            }
                         }
                     }
 
                     // TODO: first pointers can be precomputed
-                    for (int rG = rGfirst; rG >= rGlast; rG = ft[rG]) {
+                    for (int rG = rGfirst; rG >= rGlast; rG = UseFnFt ? ft[rG] : prevInForest(it2preR_to_preL, rG, lG, rGlast)) {
                         t[lG - it2PreLoff][rG - it2PreRoff] = s[rFlast - it1PreRoff][rG - it2PreRoff];
                     }
                 }
@@ -611,7 +722,7 @@ private:
 
     //--------------------------------------------------------------------------
 
-    float spfL(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, bool treesSwapped) {
+    Cost spfL(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, bool treesSwapped) {
         // Initialise the array to store the keyroot nodes in the right-hand input subtree.
         std::vector<int> keyRoots(it2->sizes[it2->getCurrentNode()], -1);
 
@@ -625,10 +736,8 @@ private:
         int firstKeyRoot = computeKeyRoots(it2, it2->getCurrentNode(), pathID, keyRoots, 0);
 
         // Initialise an array to store intermediate distances for subforest pairs.
-        std::vector<std::vector<float>> forestdist(it1->sizes[it1->getCurrentNode()] + 1);
-        for (size_t i = 0; i < forestdist.size(); i++) {
-            forestdist[i].resize(it2->sizes[it2->getCurrentNode()] + 1);
-        }
+        DeltaMatrix<Cost> forestdist;
+        allocateTable(forestdist, it1->sizes[it1->getCurrentNode()] + 1, it2->sizes[it2->getCurrentNode()] + 1, 0);
 
         // Compute the distances between pairs of keyroot nodes. In the left-hand
         // input subtree only the root is the keyroot. Thus, we compute the distance
@@ -669,7 +778,7 @@ private:
         return index;
     }
 
-    void treeEditDist(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, int it1subtree, int it2subtree, std::vector<std::vector<float>> &forestdist, bool treesSwapped) {
+    void treeEditDist(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, int it1subtree, int it2subtree, DeltaMatrix<Cost> &forestdist, bool treesSwapped) {
         // Translate input subtree root nodes to left-to-right postorder.
         int i = it1->preL_to_postL[it1subtree];
         int j = it2->preL_to_postL[it2subtree];
@@ -683,9 +792,9 @@ private:
         int joff = it2->postL_to_lld[j] - 1;
 
         // Variables holding costs of each minimum element.
-        float da = 0;
-        float db = 0;
-        float dc = 0;
+        Cost da = 0;
+        Cost db = 0;
+        Cost dc = 0;
 
         // Initialize forestdist array with deletion and insertion costs of each
         // relevant subforest.
@@ -704,7 +813,7 @@ private:
                 counter++;
 
                 // Calculate partial distance values for this subproblem.
-                float u = (treesSwapped ? this->costModel->renameCost(it2->postL_to_node(j1 + joff), it1->postL_to_node(i1 + ioff)) : this->costModel->renameCost(it1->postL_to_node(i1 + ioff), it2->postL_to_node(j1 + joff))); // USE COST MODEL - rename i1 to j1.
+                Cost u = (treesSwapped ? this->costModel->renameCost(it2->postL_to_node(j1 + joff), it1->postL_to_node(i1 + ioff)) : this->costModel->renameCost(it1->postL_to_node(i1 + ioff), it2->postL_to_node(j1 + joff))); // USE COST MODEL - rename i1 to j1.
                 da = forestdist[i1 - 1][j1] + (treesSwapped ? this->costModel->insertCost(it1->postL_to_node(i1 + ioff)) : this->costModel->deleteCost(it1->postL_to_node(i1 + ioff))); // USE COST MODEL - delete i1.
                 db = forestdist[i1][j1 - 1] + (treesSwapped ? this->costModel->deleteCost(it2->postL_to_node(j1 + joff)) : this->costModel->insertCost(it2->postL_to_node(j1 + joff))); // USE COST MODEL - insert j1.
 
@@ -731,7 +840,7 @@ private:
 
     //--------------------------------------------------------------------------
 
-    float spfR(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, bool treesSwapped) {
+    Cost spfR(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, bool treesSwapped) {
         // Initialise the array to store the keyroot nodes in the right-hand input subtree.
         std::vector<int> revKeyRoots(it2->sizes[it2->getCurrentNode()], -1);
 
@@ -745,10 +854,8 @@ private:
         int firstKeyRoot = computeRevKeyRoots(it2, it2->getCurrentNode(), pathID, revKeyRoots, 0);
 
         // Initialise an array to store intermediate distances for subforest pairs.
-        std::vector<std::vector<float>> forestdist(it1->sizes[it1->getCurrentNode()] + 1);
-        for (size_t i = 0; i < forestdist.size(); i++) {
-            forestdist[i].resize(it2->sizes[it2->getCurrentNode()] + 1);
-        }
+        DeltaMatrix<Cost> forestdist;
+        allocateTable(forestdist, it1->sizes[it1->getCurrentNode()] + 1, it2->sizes[it2->getCurrentNode()] + 1, 0);
 
         // Compute the distances between pairs of keyroot nodes. In the left-hand
         // input subtree only the root is the keyroot. Thus, we compute the distance
@@ -790,7 +897,7 @@ private:
         return index;
     }
 
-    void revTreeEditDist(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, int it1subtree, int it2subtree, std::vector<std::vector<float>> &forestdist, bool treesSwapped) {
+    void revTreeEditDist(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, int it1subtree, int it2subtree, DeltaMatrix<Cost> &forestdist, bool treesSwapped) {
         // Translate input subtree root nodes to right-to-left postorder.
         int i = it1->preL_to_postR[it1subtree];
         int j = it2->preL_to_postR[it2subtree];
@@ -804,9 +911,9 @@ private:
         int joff = it2->postR_to_rld[j] - 1;
 
         // Variables holding costs of each minimum element.
-        float da = 0;
-        float db = 0;
-        float dc = 0;
+        Cost da = 0;
+        Cost db = 0;
+        Cost dc = 0;
 
         // Initialize forestdist array with deletion and insertion costs of each
         // relevant subforest.
@@ -825,7 +932,7 @@ private:
                 counter++;
 
                 // Calculate partial distance values for this subproblem.
-                float u = (treesSwapped ? this->costModel->renameCost(it2->postR_to_node(j1 + joff), it1->postR_to_node(i1 + ioff)) : this->costModel->renameCost(it1->postR_to_node(i1 + ioff), it2->postR_to_node(j1 + joff))); // USE COST MODEL - rename i1 to j1.
+                Cost u = (treesSwapped ? this->costModel->renameCost(it2->postR_to_node(j1 + joff), it1->postR_to_node(i1 + ioff)) : this->costModel->renameCost(it1->postR_to_node(i1 + ioff), it2->postR_to_node(j1 + joff))); // USE COST MODEL - rename i1 to j1.
                 da = forestdist[i1 - 1][j1] + (treesSwapped ? this->costModel->insertCost(it1->postR_to_node(i1 + ioff)) : this->costModel->deleteCost(it1->postR_to_node(i1 + ioff))); // USE COST MODEL - delete i1.
                 db = forestdist[i1][j1 - 1] + (treesSwapped ? this->costModel->deleteCost(it2->postR_to_node(j1 + joff)) : this->costModel->insertCost(it2->postR_to_node(j1 + joff))); // USE COST MODEL - insert j1.
                 
@@ -851,25 +958,25 @@ private:
 
     //--------------------------------------------------------------------------
 
-    float spf1 (NodeIndexer<Data>* ni1, int subtreeRootNode1, NodeIndexer<Data>* ni2, int subtreeRootNode2) {
+    Cost spf1 (NodeIndexer<Data>* ni1, int subtreeRootNode1, NodeIndexer<Data>* ni2, int subtreeRootNode2) {
         int subtreeSize1 = ni1->sizes[subtreeRootNode1];
         int subtreeSize2 = ni2->sizes[subtreeRootNode2];
 
         if (subtreeSize1 == 1 && subtreeSize2 == 1) {
             Node<Data>* n1 = ni1->preL_to_node[subtreeRootNode1];
             Node<Data>* n2 = ni2->preL_to_node[subtreeRootNode2];
-            float maxCost = this->costModel->deleteCost(n1) + this->costModel->insertCost(n2);
-            float renCost = this->costModel->renameCost(n1, n2);
+            Cost maxCost = this->costModel->deleteCost(n1) + this->costModel->insertCost(n2);
+            Cost renCost = this->costModel->renameCost(n1, n2);
             return renCost < maxCost ? renCost : maxCost;
         }
 
         if (subtreeSize1 == 1) {
             Node<Data>* n1 = ni1->preL_to_node[subtreeRootNode1];
             Node<Data>* n2 = nullptr;
-            float cost = ni2->preL_to_sumInsCost[subtreeRootNode2];
-            float maxCost = cost + this->costModel->deleteCost(n1);
-            float minRenMinusIns = cost;
-            float nodeRenMinusIns = 0;
+            Cost cost = ni2->preL_to_sumInsCost[subtreeRootNode2];
+            Cost maxCost = cost + this->costModel->deleteCost(n1);
+            Cost minRenMinusIns = cost;
+            Cost nodeRenMinusIns = 0;
             for (int i = subtreeRootNode2; i < subtreeRootNode2 + subtreeSize2; i++) {
                 n2 = ni2->preL_to_node[i];
                 nodeRenMinusIns = this->costModel->renameCost(n1, n2) - this->costModel->insertCost(n2);
@@ -886,10 +993,10 @@ private:
             Node<Data>* n1 = nullptr;
             Node<Data>* n2 = ni2->preL_to_node[subtreeRootNode2];
 
-            float cost = ni1->preL_to_sumDelCost[subtreeRootNode1];
-            float maxCost = cost + this->costModel->insertCost(n2);
-            float minRenMinusDel = cost;
-            float nodeRenMinusDel = 0;
+            Cost cost = ni1->preL_to_sumDelCost[subtreeRootNode1];
+            Cost maxCost = cost + this->costModel->insertCost(n2);
+            Cost minRenMinusDel = cost;
+            Cost nodeRenMinusDel = 0;
 
             for (int i = subtreeRootNode1; i < subtreeRootNode1 + subtreeSize1; i++) {
                 n1 = ni1->preL_to_node[i];
@@ -909,15 +1016,97 @@ private:
 
     //--------------------------------------------------------------------------
 
-    void computeOptStrategy_postL() {
+    bool isIdenticalSubtree(NodeIndexer<Data>* ni1, int subtreeRootNode1, NodeIndexer<Data>* ni2, int subtreeRootNode2) {
+        if (!this->costModel->hasZeroSelfRenameCost()) {
+            return false;
+        }
+
+        int subtreeSize = ni1->sizes[subtreeRootNode1];
+        if (subtreeSize != ni2->sizes[subtreeRootNode2] || ni1->preL_to_hash[subtreeRootNode1] != ni2->preL_to_hash[subtreeRootNode2]) {
+            return false;
+        }
+
+        // Equal hashes are only a hint. Preorder subtree sizes fix the shape, so
+        // confirm those and the labels to make sure a collision can never change
+        // the result.
+        for (int i = 0; i < subtreeSize; i++) {
+            if (ni1->sizes[subtreeRootNode1 + i] != ni2->sizes[subtreeRootNode2 + i]) {
+                return false;
+            }
+            if (this->costModel->renameCost(ni1->preL_to_node[subtreeRootNode1 + i], ni2->preL_to_node[subtreeRootNode2 + i]) != 0.0f) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Upper bound on the memory next to delta while computing distances: q, fn
+    // and ft, and the tables of one single-path function. spfA's are the
+    // largest, s has (size1 + 1) * (size2 + 1) entries and t up to
+    // (max(size1, size2) + 1)^2, depending on which tree holds the path.
+    static size_t getScratchBytes(size_t size1, size_t size2) {
+        size_t maxSize = std::max(size1, size2) + 1;
+        size_t initBytes = maxSize * sizeof(Cost) + 2 * (maxSize + 1) * sizeof(int);
+        size_t tableBytes = ((size1 + 1) * (size2 + 1) + maxSize * maxSize) * sizeof(Cost);
+        return initBytes + tableBytes;
+    }
+
+    // Checked before the strategy, which already needs delta. Throws
+    // MemoryBudgetExceeded under BudgetPolicy::FAIL, and returns false under
+    // BudgetPolicy::APPROXIMATE, if delta and the scratch memory may not fit.
+    bool fitsMemoryBudget() const {
+        size_t deltaBytes = DeltaMatrix<Cost>::getBytes(this->size1, this->size2);
+        size_t scratchBytes = getScratchBytes(this->size1, this->size2);
+        if (deltaBytes + scratchBytes <= memoryBudget || budgetPolicy == BudgetPolicy::FILE_BACKED) {
+            return true;
+        }
+
+        if (budgetPolicy == BudgetPolicy::FAIL) {
+            throw MemoryBudgetExceeded(this->size1, this->size2, deltaBytes, scratchBytes, memoryBudget);
+        }
+        return false;
+    }
+
+    // What is left of the memory budget after usedBytes
+    size_t getRemainingBudget(size_t usedBytes) const {
+        return memoryBudget > usedBytes ? memoryBudget - usedBytes : 0;
+    }
+
+    // Leaves room for the scratch memory, so that under
+    // BudgetPolicy::FILE_BACKED a delta that fits on its own can still go to a
+    // file to keep the peak within the budget.
+    void allocateDelta(int size1, int size2) {
+        assert(delta.size() == 0);
+        delta.allocate(size1, size2, getRemainingBudget(getScratchBytes(size1, size2)), budgetPolicy);
+
+        CAPTED_STATS_ONLY(
+            if (stats) {
+                stats->deltaBytes = DeltaMatrix<Cost>::getBytes(size1, size2);
+                stats->fileBackedDelta = delta.isFileBacked();
+            }
+        )
+    }
+
+    // A single-path function table gets what is left of the memory budget
+    // after delta, q, fn, ft and the function's other table (otherBytes), and
+    // is file-backed past that like delta.
+    void allocateTable(DeltaMatrix<Cost> &table, int rows, int cols, size_t otherBytes) {
+        size_t usedBytes = delta.getHeapBytes() + q.size() * sizeof(Cost) + (fn.size() + ft.size()) * sizeof(int) + otherBytes;
+        table.allocate(rows, cols, getRemainingBudget(usedBytes), budgetPolicy);
+
+        CAPTED_STATS_ONLY(if (stats) { stats->fileBackedTables |= table.isFileBacked(); })
+    }
+
+    // Both strategy functions return the predicted number of subproblems for
+    // the whole trees, i.e. the cost of the strategy found [2, Section 5].
+    float computeOptStrategy_postL() {
         int size1 = this->it1->getSize();
         int size2 = this->it2->getSize();
 
-        assert(delta.size() == 0);
-        delta.resize(size1);
-        for (size_t i = 0; i < delta.size(); i++) {
-            delta[i].resize(size2);
-        }
+        allocateDelta(size1, size2);
 
         std::vector<std::vector<float>> cost1_L(size1);
         std::vector<std::vector<float>> cost1_R(size1);
@@ -928,7 +1117,7 @@ private:
         std::vector<int> cost2_path(size2);
         std::vector<float> leafRow(size2);
         int pathIDOffset = size1;
-        float minCost = 0x7fffffffffffffffL;
+        float minCost = std::numeric_limits<float>::max();
         int strategyPath = -1;
 
         std::vector<int> &pre2size1 = this->it1->sizes;
@@ -964,13 +1153,15 @@ private:
         int leftPath_v,
             rightPath_v;
 
-        std::vector<float> cost_Lpointer_v,
-                           cost_Rpointer_v,
-                           cost_Ipointer_v;
-        std::vector<float> cost_Lpointer_parent_v, 
-                           cost_Rpointer_parent_v,
-                           cost_Ipointer_parent_v;
-        std::vector<float> strategypointer_parent_v;
+        // Rows are updated in place through these, the costs of the children
+        // accumulate in the parent's rows.
+        float* cost_Lpointer_v = nullptr;
+        float* cost_Rpointer_v = nullptr;
+        float* cost_Ipointer_v = nullptr;
+        float* cost_Lpointer_parent_v = nullptr;
+        float* cost_Rpointer_parent_v = nullptr;
+        float* cost_Ipointer_parent_v = nullptr;
+        Cost* strategypointer_parent_v = nullptr;
 
         int krSum_v, revkrSum_v, descSum_v;
         bool is_v_leaf;
@@ -1008,9 +1199,9 @@ private:
                 }
             }
 
-            cost_Lpointer_v = cost1_L[v];
-            cost_Rpointer_v = cost1_R[v];
-            cost_Ipointer_v = cost1_I[v];
+            cost_Lpointer_v = cost1_L[v].data();
+            cost_Rpointer_v = cost1_R[v].data();
+            cost_Ipointer_v = cost1_I[v].data();
 
             if (parent_v_preL != -1 && cost1_L[parent_v_postL].size() == 0) {
                 if (rowsToReuse_L.empty()) {
@@ -1018,21 +1209,21 @@ private:
                     cost1_R[parent_v_postL] = std::vector<float>(size2);
                     cost1_I[parent_v_postL] = std::vector<float>(size2);
                 } else {
-                    cost1_L[parent_v_postL] = rowsToReuse_L.top();
+                    cost1_L[parent_v_postL] = std::move(rowsToReuse_L.top());
                     rowsToReuse_L.pop();
 
-                    cost1_R[parent_v_postL] = rowsToReuse_R.top();
+                    cost1_R[parent_v_postL] = std::move(rowsToReuse_R.top());
                     rowsToReuse_R.pop();
 
-                    cost1_I[parent_v_postL] = rowsToReuse_I.top();
+                    cost1_I[parent_v_postL] = std::move(rowsToReuse_I.top());
                     rowsToReuse_I.pop();
                 }
             }
 
             if (parent_v_preL != -1) {
-                cost_Lpointer_parent_v = cost1_L[parent_v_postL];
-                cost_Rpointer_parent_v = cost1_R[parent_v_postL];
-                cost_Ipointer_parent_v = cost1_I[parent_v_postL];
+                cost_Lpointer_parent_v = cost1_L[parent_v_postL].data();
+                cost_Rpointer_parent_v = cost1_R[parent_v_postL].data();
+                cost_Ipointer_parent_v = cost1_I[parent_v_postL].data();
                 strategypointer_parent_v = delta[parent_v_preL];
             }
 
@@ -1057,9 +1248,9 @@ private:
                     cost2_path[w] = w_in_preL;
                 }
 
-                minCost = 0x7fffffffffffffffL;
+                minCost = std::numeric_limits<float>::max();
                 strategyPath = -1;
-                float tmpCost = 0x7fffffffffffffffL;
+                float tmpCost = std::numeric_limits<float>::max();
 
                 if (size_v <= 1 || size_w <= 1) { // USE NEW SINGLE_PATH FUNCTIONS FOR SMALL SUBTREES
                     minCost = std::max(size_v, size_w);
@@ -1137,22 +1328,20 @@ private:
                 fillArray(cost1_L[v], 0.0f);
                 fillArray(cost1_R[v], 0.0f);
                 fillArray(cost1_I[v], 0.0f);
-                rowsToReuse_L.push(cost1_L[v]);
-                rowsToReuse_R.push(cost1_R[v]);
-                rowsToReuse_I.push(cost1_I[v]);
+                rowsToReuse_L.push(std::move(cost1_L[v]));
+                rowsToReuse_R.push(std::move(cost1_R[v]));
+                rowsToReuse_I.push(std::move(cost1_I[v]));
             }
         }
+
+        return minCost;
     }
 
-    void computeOptStrategy_postR() {
+    float computeOptStrategy_postR() {
         int size1 = this->it1->getSize();
         int size2 = this->it2->getSize();
 
-        assert(delta.size() == 0);
-        delta.resize(size1);
-        for (size_t i = 0; i < delta.size(); i++) {
-            delta[i].resize(size2);
-        }
+        allocateDelta(size1, size2);
 
         std::vector<std::vector<float>> cost1_L(size1);
         std::vector<std::vector<float>> cost1_R(size1);
@@ -1163,7 +1352,7 @@ private:
         std::vector<int> cost2_path(size2);
         std::vector<float> leafRow(size2);
         int pathIDOffset = size1;
-        float minCost = 0x7fffffffffffffffL;
+        float minCost = std::numeric_limits<float>::max();
         int strategyPath = -1;
 
         std::vector<int> &pre2size1 = this->it1->sizes;
@@ -1191,13 +1380,15 @@ private:
             parent_w;
         int leftPath_v,
             rightPath_v;
-        std::vector<float> cost_Lpointer_v,
-                           cost_Rpointer_v,
-                           cost_Ipointer_v;
-        std::vector<float> cost_Lpointer_parent_v, 
-                           cost_Rpointer_parent_v,
-                           cost_Ipointer_parent_v;
-        std::vector<float> strategypointer_parent_v;
+        // Rows are updated in place through these, the costs of the children
+        // accumulate in the parent's rows.
+        float* cost_Lpointer_v = nullptr;
+        float* cost_Rpointer_v = nullptr;
+        float* cost_Ipointer_v = nullptr;
+        float* cost_Lpointer_parent_v = nullptr;
+        float* cost_Rpointer_parent_v = nullptr;
+        float* cost_Ipointer_parent_v = nullptr;
+        Cost* strategypointer_parent_v = nullptr;
         int krSum_v, 
             revkrSum_v,
             descSum_v;
@@ -1227,9 +1418,9 @@ private:
                 }
             }
 
-            cost_Lpointer_v = cost1_L[v];
-            cost_Rpointer_v = cost1_R[v];
-            cost_Ipointer_v = cost1_I[v];
+            cost_Lpointer_v = cost1_L[v].data();
+            cost_Rpointer_v = cost1_R[v].data();
+            cost_Ipointer_v = cost1_I[v].data();
 
             if (parent_v != -1 && cost1_L[parent_v].size() == 0) {
                 if (rowsToReuse_L.empty()) {
@@ -1237,21 +1428,21 @@ private:
                     cost1_R[parent_v] = std::vector<float>(size2);
                     cost1_I[parent_v] = std::vector<float>(size2);
                 } else {
-                    cost1_L[parent_v] = rowsToReuse_L.top();
+                    cost1_L[parent_v] = std::move(rowsToReuse_L.top());
                     rowsToReuse_L.pop();
 
-                    cost1_R[parent_v] = rowsToReuse_R.top();
+                    cost1_R[parent_v] = std::move(rowsToReuse_R.top());
                     rowsToReuse_R.pop();
 
-                    cost1_I[parent_v] = rowsToReuse_I.top();
+                    cost1_I[parent_v] = std::move(rowsToReuse_I.top());
                     rowsToReuse_I.pop();
                 }
             }
 
             if (parent_v != -1) {
-                cost_Lpointer_parent_v = cost1_L[parent_v];
-                cost_Rpointer_parent_v = cost1_R[parent_v];
-                cost_Ipointer_parent_v = cost1_I[parent_v];
+                cost_Lpointer_parent_v = cost1_L[parent_v].data();
+                cost_Rpointer_parent_v = cost1_R[parent_v].data();
+                cost_Ipointer_parent_v = cost1_I[parent_v].data();
                 strategypointer_parent_v = delta[parent_v];
             }
 
@@ -1269,9 +1460,9 @@ private:
                     cost2_path[w] = w;
                 }
 
-                minCost = 0x7fffffffffffffffL;
+                minCost = std::numeric_limits<float>::max();
                 strategyPath = -1;
-                float tmpCost = 0x7fffffffffffffffL;
+                float tmpCost = std::numeric_limits<float>::max();
 
                 if (size_v <= 1 || size_w <= 1) { // USE NEW SINGLE_PATH FUNCTIONS FOR SMALL SUBTREES
                     minCost = std::max(size_v, size_w);
@@ -1350,11 +1541,13 @@ private:
                 fillArray(cost1_L[v], 0.0f);
                 fillArray(cost1_R[v], 0.0f);
                 fillArray(cost1_I[v], 0.0f);
-                rowsToReuse_L.push(cost1_L[v]);
-                rowsToReuse_R.push(cost1_R[v]);
-                rowsToReuse_I.push(cost1_I[v]);
+                rowsToReuse_L.push(std::move(cost1_L[v]));
+                rowsToReuse_R.push(std::move(cost1_R[v]));
+                rowsToReuse_I.push(std::move(cost1_I[v]));
             }
         }
+
+        return minCost;
     }
 
     void tedInit() {
@@ -1364,12 +1557,13 @@ private:
         // Initialize arrays.
         int maxSize = std::max(this->size1, this->size2) + 1;
 
-        // TODO: Move q initialisation to spfA.
-        q.resize(maxSize);
-
-        // TODO: Do not use fn and ft arrays [1, Section 8.4].
-        fn.resize(maxSize + 1);
-        ft.resize(maxSize + 1);
+        // Only used by spfA with the fn and ft arrays.
+        if (innerPathArrays) {
+            // TODO: Move q initialisation to spfA.
+            q.resize(maxSize);
+            fn.resize(maxSize + 1);
+            ft.resize(maxSize + 1);
+        }
 
         // Compute subtree distances without the root nodes when one of subtrees
         // is a single node.
@@ -1404,107 +1598,582 @@ private:
 
     //--------------------------------------------------------------------------
 
-    float gted(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2) {
-        int currentSubtree1 = it1->getCurrentNode();
-        int currentSubtree2 = it2->getCurrentNode();
-        int subtreeSize1 = it1->sizes[currentSubtree1];
-        int subtreeSize2 = it2->sizes[currentSubtree2];
+    SubtreeCache::Key getCacheKey(int subtreeRootNode1, int subtreeRootNode2) {
+        SubtreeCache::Key key;
+        key.hash1 = this->it1->preL_to_hash[subtreeRootNode1];
+        key.hash2 = this->it2->preL_to_hash[subtreeRootNode2];
+        key.modelId = this->costModel->getModelId();
+        key.size1 = this->it1->sizes[subtreeRootNode1];
+        key.size2 = this->it2->sizes[subtreeRootNode2];
+        return key;
+    }
+
+    bool canUseCache(int subtreeSize1, int subtreeSize2) {
+        return subtreeCache != nullptr &&
+               this->costModel->hasZeroSelfRenameCost() &&
+               subtreeCache->accepts(subtreeSize1, subtreeSize2);
+    }
+
+    // Once gted returns for a pair, every delta entry that the enclosing
+    // single-path functions may read lies in the pair's block and only depends
+    // on the two subtrees. Entries in the block that are never read may still
+    // hold strategy paths; copying those around is harmless.
+    void saveDeltaBlock(int subtreeRootNode1, int subtreeRootNode2, std::vector<float> &block) {
+        int subtreeSize1 = this->it1->sizes[subtreeRootNode1];
+        int subtreeSize2 = this->it2->sizes[subtreeRootNode2];
+        block.resize((size_t)subtreeSize1 * subtreeSize2);
+
+        for (int i = 0; i < subtreeSize1; i++) {
+            Cost* row = delta[subtreeRootNode1 + i];
+            std::copy(row + subtreeRootNode2, row + subtreeRootNode2 + subtreeSize2, block.begin() + (size_t)i * subtreeSize2);
+        }
+    }
+
+    void restoreDeltaBlock(int subtreeRootNode1, int subtreeRootNode2, const std::vector<float> &block) {
+        int subtreeSize1 = this->it1->sizes[subtreeRootNode1];
+        int subtreeSize2 = this->it2->sizes[subtreeRootNode2];
+        assert(block.size() == (size_t)subtreeSize1 * subtreeSize2);
+
+        for (int i = 0; i < subtreeSize1; i++) {
+            auto blockRow = block.begin() + (size_t)i * subtreeSize2;
+            std::copy(blockRow, blockRow + subtreeSize2, delta[subtreeRootNode1 + i] + subtreeRootNode2);
+        }
+    }
+
+    // Runs the single-path function for the strategy path type of the current
+    // subtree pair.
+    Cost spf(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, int pathID, int pathType, bool treesSwapped) {
+        CAPTED_STATS_ONLY(long subproblemsBefore = counter;)
+
+        Cost distance;
+        if (pathType == LEFT) {
+            distance = spfL(it1, it2, treesSwapped);
+        } else if (pathType == RIGHT) {
+            distance = spfR(it1, it2, treesSwapped);
+        } else {
+            distance = innerPathArrays ? spfA<true>(it1, it2, pathID, pathType, treesSwapped) : spfA<false>(it1, it2, pathID, pathType, treesSwapped);
+        }
+
+        CAPTED_STATS_ONLY(
+            if (stats) {
+                long subproblems = counter - subproblemsBefore;
+                size_t rows = it1->sizes[it1->getCurrentNode()] + 1;
+                size_t cols = it2->sizes[it2->getCurrentNode()] + 1;
+                size_t tableBytes;
+
+                if (pathType == LEFT || pathType == RIGHT) {
+                    stats->leftPaths += (pathType == LEFT);
+                    stats->rightPaths += (pathType == RIGHT);
+                    (pathType == LEFT ? stats->spfLSubproblems : stats->spfRSubproblems) += subproblems;
+                    tableBytes = rows * cols * sizeof(Cost) + (cols - 1) * sizeof(int);
+                } else {
+                    stats->innerPaths++;
+                    stats->spfASubproblems += subproblems;
+                    tableBytes = (rows * cols + cols * cols) * sizeof(Cost);
+                }
+
+                size_t initBytes = q.size() * sizeof(Cost) + (fn.size() + ft.size()) * sizeof(int);
+                stats->scratchBytes = std::max(stats->scratchBytes, initBytes + tableBytes);
+            }
+        )
+
+        return distance;
+    }
+
+    // Computes the distances between all relevant subtree pairs of the current
+    // subtrees of it1 and it2 [1, Algorithm 1].
+    //
+    // The recursion runs on an explicit stack, so deep trees need no thread
+    // stack. A pair is popped twice: first it pushes itself back as expanded,
+    // with the pairs of subtrees hanging off its strategy path above it, and
+    // once those have all been solved it is solved by a single-path function.
+    // Sibling pairs are independent, so the order they are solved in does not
+    // matter.
+    Cost gted(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2) {
+        Cost distance = 0;
+        gtedStack.clear();
+        gtedStack.push_back(GtedFrame{it1->getCurrentNode(), it2->getCurrentNode()});
+
+        while (!gtedStack.empty()) {
+            GtedFrame frame = gtedStack.back();
+            gtedStack.pop_back();
+
+            if (frame.expanded) {
+                distance = solveSubtreePair(it1, it2, frame);
+                continue;
+            }
+
+            int subtreeSize1 = it1->sizes[frame.subtree1];
+            int subtreeSize2 = it2->sizes[frame.subtree2];
+
+            // Use spf1.
+            if (subtreeSize1 == 1 || subtreeSize2 == 1) {
+                CAPTED_STATS_ONLY(if (stats) { stats->spf1Calls++; })
+                distance = spf1(it1, frame.subtree1, it2, frame.subtree2);
+                continue;
+            }
 
-        // Use spf1.
-        if ((subtreeSize1 == 1 || subtreeSize2 == 1)) {
-            return spf1(it1, currentSubtree1, it2, currentSubtree2);
+            // Out of time, drop everything left on the stack. The clock is
+            // only read for pairs that need a single-path function.
+            if (hasTimeBudget && std::chrono::steady_clock::now() > deadline) {
+                stopped = true;
+                gtedStack.clear();
+                return 0;
+            }
+
+            // The pair of whole trees is looked up by computeEditDistance() before
+            // the strategy is computed.
+            bool isRootPair = (frame.subtree1 == 0 && frame.subtree2 == 0);
+            if (!isRootPair && canUseCache(subtreeSize1, subtreeSize2)) {
+                std::shared_ptr<const SubtreeCache::Entry> cached = subtreeCache->find(getCacheKey(frame.subtree1, frame.subtree2));
+                if (cached && !cached->delta.empty()) {
+                    restoreDeltaBlock(frame.subtree1, frame.subtree2, cached->delta);
+                    continue;
+                }
+                frame.saveToCache = true;
+            }
+
+            expandSubtreePair(it1, it2, frame);
         }
 
-        int strategyPathID = (int)delta[currentSubtree1][currentSubtree2];
+        return distance;
+    }
 
-        int strategyPathType = -1;
+    // Reads the strategy path of the pair, which the single-path functions of
+    // the relevant subtrees may overwrite, and pushes the pair followed by the
+    // relevant subtree pairs.
+    void expandSubtreePair(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, GtedFrame frame) {
+        int strategyPathID = (int)delta[frame.subtree1][frame.subtree2];
         int currentPathNode = std::abs(strategyPathID) - 1;
         int pathIDOffset = it1->getSize();
-
         int parent = -1;
-        if(currentPathNode < pathIDOffset) {
-            strategyPathType = getStrategyPathType(strategyPathID, pathIDOffset, it1, currentSubtree1, subtreeSize1);
-            while((parent = it1->parents[currentPathNode]) >= currentSubtree1) {
-                std::vector<int> ai;
-                int k = (ai = it1->children[parent]).size();
-                for(int i = 0; i < k; i++) {
-                    int child = ai[i];
-                    if(child != currentPathNode) {
-                        it1->setCurrentNode(child);
-                        gted(it1, it2);
+
+        frame.expanded = true;
+
+        if (currentPathNode < pathIDOffset) {
+            frame.pathID = currentPathNode;
+            frame.pathType = getStrategyPathType(strategyPathID, pathIDOffset, it1, frame.subtree1, it1->sizes[frame.subtree1]);
+            frame.treesSwapped = false;
+            gtedStack.push_back(frame);
+
+            while ((parent = it1->parents[currentPathNode]) >= frame.subtree1) {
+                for (int child : it1->children[parent]) {
+                    if (child != currentPathNode) {
+                        gtedStack.push_back(GtedFrame{child, frame.subtree2});
                     }
                 }
                 currentPathNode = parent;
             }
-            // TODO: Move this property away from node indexer and pass directly to spfs.
-            it1->setCurrentNode(currentSubtree1);
-
-            // Pass to spfs a bool that says says if the order of input subtrees
-            // has been swapped compared to the order of the initial input trees.
-            // Used for accessing delta array and deciding on the edit operation
-            // [1, Section 3.4].
-            if (strategyPathType == 0) {
-                return spfL(it1, it2, false);
-            }
-            if (strategyPathType == 1) {
-                return spfR(it1, it2, false);
-            }
-            return spfA(it1, it2, std::abs(strategyPathID) - 1, strategyPathType, false);
+            return;
         }
 
         currentPathNode -= pathIDOffset;
-        strategyPathType = getStrategyPathType(strategyPathID, pathIDOffset, it2, currentSubtree2, subtreeSize2);
-        while((parent = it2->parents[currentPathNode]) >= currentSubtree2) {
-            std::vector<int> ai1;
-            int l = (ai1 = it2->children[parent]).size();
-            for(int j = 0; j < l; j++) {
-                int child = ai1[j];
-                if(child != currentPathNode) {
-                    it2->setCurrentNode(child);
-                    gted(it1, it2);
+        frame.pathID = currentPathNode;
+        frame.pathType = getStrategyPathType(strategyPathID, pathIDOffset, it2, frame.subtree2, it2->sizes[frame.subtree2]);
+        frame.treesSwapped = true;
+        gtedStack.push_back(frame);
+
+        while ((parent = it2->parents[currentPathNode]) >= frame.subtree2) {
+            for (int child : it2->children[parent]) {
+                if (child != currentPathNode) {
+                    gtedStack.push_back(GtedFrame{frame.subtree1, child});
                 }
             }
             currentPathNode = parent;
         }
+    }
+
+    Cost solveSubtreePair(NodeIndexer<Data>* it1, NodeIndexer<Data>* it2, const GtedFrame &frame) {
         // TODO: Move this property away from node indexer and pass directly to spfs.
-        it2->setCurrentNode(currentSubtree2);
+        it1->setCurrentNode(frame.subtree1);
+        it2->setCurrentNode(frame.subtree2);
 
         // Pass to spfs a bool that says says if the order of input subtrees
-        // has been swapped compared to the order of the initial input trees. Used
-        // for accessing delta array and deciding on the edit operation
+        // has been swapped compared to the order of the initial input trees.
+        // Used for accessing delta array and deciding on the edit operation
         // [1, Section 3.4].
-        if (strategyPathType == 0) {
-            return spfL(it2, it1, true);
+        Cost distance;
+        if (frame.treesSwapped) {
+            distance = spf(it2, it1, frame.pathID, frame.pathType, true);
+        } else {
+            distance = spf(it1, it2, frame.pathID, frame.pathType, false);
         }
-        if (strategyPathType == 1) {
-            return spfR(it2, it1, true);
+
+        if (frame.saveToCache) {
+            std::shared_ptr<SubtreeCache::Entry> entry = std::make_shared<SubtreeCache::Entry>();
+            entry->distance = distance;
+            saveDeltaBlock(frame.subtree1, frame.subtree2, entry->delta);
+            subtreeCache->insert(getCacheKey(frame.subtree1, frame.subtree2), entry);
         }
 
-        return spfA(it2, it1, std::abs(strategyPathID) - pathIDOffset - 1, strategyPathType, true);
+        return distance;
     }
 
-public:
-    Apted(CostModel<Data>* costModel) : TreeEditDistance<Data>(costModel) {
-        // nop
+    //--------------------------------------------------------------------------
+
+    // Delta holds both distances and strategy path IDs, which go up to
+    // size1 + size2. No distance exceeds deleting and inserting everything.
+    bool fitsCostType() const {
+        if (std::is_floating_point<Cost>::value) {
+            return true;
+        }
+
+        double maxValue = std::max((double)this->size1 + this->size2, (double)this->it1->preL_to_sumDelCost[0] + this->it2->preL_to_sumInsCost[0]);
+        return this->costModel->hasIntegerCosts() && maxValue <= std::numeric_limits<Cost>::max();
     }
 
-    virtual float computeEditDistance(Node<Data>* t1, Node<Data>* t2) override {
-        // Index the nodes of both input trees.
-        this->init(t1, t2);
+    float computeOptStrategy() {
+        bool useCache = strategyCache != nullptr && strategyCache->accepts(this->size1, this->size2);
+        StrategyCache::Key cacheKey;
+
+        if (useCache) {
+            cacheKey = {this->it1->shapeHash, this->it2->shapeHash, this->size1, this->size2};
+            std::shared_ptr<const StrategyCache::Entry> cached = strategyCache->find(cacheKey);
+            if (cached && cached->sizes1 == this->it1->sizes && cached->sizes2 == this->it2->sizes) {
+                CAPTED_STATS_ONLY(if (stats) { stats->cachedStrategy = true; })
+                restoreStrategy(cached->strategy);
+                return cached->cost;
+            }
+        }
 
-        // Determine the optimal strategy for the distance computation.
         // Use the heuristic from [2, Section 5.3].
+        float cost;
         if (this->it1->lchl < this->it1->rchl) {
-            computeOptStrategy_postL();
+            cost = computeOptStrategy_postL();
         } else {
-            computeOptStrategy_postR();
+            cost = computeOptStrategy_postR();
+        }
+
+        if (useCache) {
+            std::shared_ptr<StrategyCache::Entry> entry = std::make_shared<StrategyCache::Entry>();
+            entry->cost = cost;
+            entry->sizes1 = this->it1->sizes;
+            entry->sizes2 = this->it2->sizes;
+            saveStrategy(entry->strategy);
+            strategyCache->insert(cacheKey, entry);
+        }
+
+        return cost;
+    }
+
+    void saveStrategy(std::vector<int> &strategy) {
+        strategy.resize((size_t)this->size1 * this->size2);
+
+        for (int v = 0; v < this->size1; v++) {
+            const Cost* row = delta[v];
+            std::copy(row, row + this->size2, strategy.begin() + (size_t)v * this->size2);
+        }
+    }
+
+    void restoreStrategy(const std::vector<int> &strategy) {
+        assert(strategy.size() == (size_t)this->size1 * this->size2);
+        allocateDelta(this->size1, this->size2);
+
+        for (int v = 0; v < this->size1; v++) {
+            auto strategyRow = strategy.begin() + (size_t)v * this->size2;
+            std::copy(strategyRow, strategyRow + this->size2, delta[v]);
+        }
+    }
+
+    // Sum of the sizes of the subtrees at the top of each heavy path
+    static double getHeavyPathRootSizeSum(NodeIndexer<Data>* ni) {
+        double sum = ni->sizes[0];
+
+        // Every child but the largest starts a new heavy path
+        for (int v = 0; v < ni->getSize(); v++) {
+            int largest = 0;
+            for (int child : ni->children[v]) {
+                sum += ni->sizes[child];
+                largest = std::max(largest, ni->sizes[child]);
+            }
+            sum -= largest;
+        }
+
+        return sum;
+    }
+
+    // The cheapest strategy that takes the same path type in every subtree of
+    // one of the trees: left paths or right paths as in Zhang and Shasha, whose
+    // cost is the product of the keyroot sums, or heavy paths as in Demaine et
+    // al., whose cost is the heavy path roots of one tree times the relevant
+    // subforests of the other. The optimal strategy can only be cheaper.
+    static float estimateIndexedCost(NodeIndexer<Data>* ni1, NodeIndexer<Data>* ni2) {
+        double left = (double)ni1->preL_to_kr_sum[0] * ni2->preL_to_kr_sum[0];
+        double right = (double)ni1->preL_to_rev_kr_sum[0] * ni2->preL_to_rev_kr_sum[0];
+        double heavy1 = getHeavyPathRootSizeSum(ni1) * ni2->preL_to_desc_sum[0];
+        double heavy2 = getHeavyPathRootSizeSum(ni2) * ni1->preL_to_desc_sum[0];
+
+        return std::min(std::min(left, right), std::min(heavy1, heavy2));
+    }
+
+    float computeIndexedCost() {
+        if (isIdenticalSubtree(this->it1, 0, this->it2, 0)) {
+            return 0.0f;
+        }
+
+        // Without room for the strategy
+        if (!fitsMemoryBudget()) {
+            return estimateIndexedCost(this->it1, this->it2);
+        }
+
+        predictedSubproblems = computeOptStrategy();
+        return predictedSubproblems;
+    }
+
+    static EditDistanceResult exactResult(float distance) {
+        return {distance, distance, distance, false};
+    }
+
+    // Bounds computed in O(n + m), returned when a budget is exceeded.
+    //
+    // The upper bound is the cheaper of two edit scripts: delete all of t1 and
+    // insert all of t2, or the same but renaming root1 to root2. The lower
+    // bound is only known for unit cost models, from the node counts and the
+    // label histograms.
+    EditDistanceResult approximateEditDistance() {
+        Node<Data>* root1 = this->it1->preL_to_node[0];
+        Node<Data>* root2 = this->it2->preL_to_node[0];
+        float sumDel = this->it1->preL_to_sumDelCost[0];
+        float sumIns = this->it2->preL_to_sumInsCost[0];
+
+        float upperBound = std::min(sumDel + sumIns, sumDel - this->costModel->deleteCost(root1) + sumIns - this->costModel->insertCost(root2) + this->costModel->renameCost(root1, root2));
+        float lowerBound = 0.0f;
+
+        if (this->costModel->isUnitCost()) {
+            std::vector<uint64_t> labels1;
+            std::vector<uint64_t> labels2;
+            for (Node<Data>* node : this->it1->preL_to_node) {
+                labels1.push_back(this->costModel->labelHash(node));
+            }
+            for (Node<Data>* node : this->it2->preL_to_node) {
+                labels2.push_back(this->costModel->labelHash(node));
+            }
+
+            int histogramBound = histogramDistance(makeLabelHistogram(labels1), makeLabelHistogram(labels2));
+            lowerBound = std::max(std::abs(this->size1 - this->size2), histogramBound);
+        }
+
+        CAPTED_STATS_ONLY(if (stats) { stats->approximate = true; })
+        return {upperBound, lowerBound, upperBound, true};
+    }
+
+    EditDistanceResult computeIndexedEditDistance() {
+        CAPTED_STATS_ONLY(
+            if (stats) {
+                *stats = AptedStats();
+                stats->memoryBudget = memoryBudget;
+            }
+        )
+
+        // Nothing is left of a previous computation on the early returns below
+        predictedSubproblems = 0;
+        counter = 0L;
+
+        if (!fitsCostType()) {
+            throw CostTypeOverflow(this->size1, this->size2);
+        }
+
+        stopped = false;
+        if (hasTimeBudget) {
+            deadline = std::chrono::steady_clock::now() + timeBudget;
+        }
+
+        // Identical trees are at distance 0. This skips the strategy and the
+        // size1*size2 delta matrix entirely, which is the common case for
+        // unmodified starter code and copied submissions.
+        //
+        // Identical subtree pairs further down are still solved normally: the
+        // enclosing single-path functions read every delta entry of the pair,
+        // not just the one between the two roots.
+        if (isIdenticalSubtree(this->it1, 0, this->it2, 0)) {
+            CAPTED_STATS_ONLY(if (stats) { stats->identicalTrees = true; })
+            return exactResult(0.0f);
+        }
+
+        // The same pair of trees may already have been compared.
+        bool useCache = subtreeCache != nullptr && this->costModel->hasZeroSelfRenameCost();
+        SubtreeCache::Key cacheKey;
+        if (useCache) {
+            cacheKey = getCacheKey(0, 0);
+            std::shared_ptr<const SubtreeCache::Entry> cached = subtreeCache->find(cacheKey);
+            if (cached) {
+                CAPTED_STATS_ONLY(if (stats) { stats->cachedResult = true; })
+                return exactResult(cached->distance);
+            }
+        }
+
+        // Over the memory budget with nowhere to put delta and the tables.
+        CAPTED_STATS_ONLY(
+            if (stats) {
+                stats->peakBytes = DeltaMatrix<Cost>::getBytes(this->size1, this->size2) + getScratchBytes(this->size1, this->size2);
+            }
+        )
+        if (!fitsMemoryBudget()) {
+            return approximateEditDistance();
+        }
+
+        // Determine the optimal strategy for the distance computation.
+        CAPTED_STATS_ONLY(auto phaseStart = std::chrono::steady_clock::now();)
+        predictedSubproblems = computeOptStrategy();
+        CAPTED_STATS_ONLY(
+            if (stats) {
+                stats->strategyNs = elapsedNs(phaseStart);
+                stats->predictedSubproblems = predictedSubproblems;
+            }
+            phaseStart = std::chrono::steady_clock::now();
+        )
+
+        if (predictedSubproblems > subproblemBudget) {
+            return approximateEditDistance();
         }
 
         // Initialise structures for distance computation.
         tedInit();
+        CAPTED_STATS_ONLY(
+            if (stats) {
+                stats->initNs = elapsedNs(phaseStart);
+            }
+            phaseStart = std::chrono::steady_clock::now();
+        )
 
         // Compute the distance.
-        return gted(this->it1, this->it2);
+        Cost distance = gted(this->it1, this->it2);
+        CAPTED_STATS_ONLY(if (stats) { stats->gtedNs = elapsedNs(phaseStart); })
+
+        if (stopped) {
+            return approximateEditDistance();
+        }
+
+        if (useCache) {
+            std::shared_ptr<SubtreeCache::Entry> entry = std::make_shared<SubtreeCache::Entry>();
+            entry->distance = distance;
+            subtreeCache->insert(cacheKey, entry);
+        }
+
+        return exactResult(distance);
+    }
+
+public:
+    Apted(CostModel<Data>* costModel) : TreeEditDistance<Data>(costModel) {
+        // nop
+    }
+
+    // Optional cache of solved subtree pairs shared across computations. Only
+    // used with cost models that provide label hashes.
+    void setSubtreeCache(SubtreeCache* subtreeCache) {
+        this->subtreeCache = subtreeCache;
+    }
+
+    // Optional cache of strategies shared across computations, used with any
+    // cost model.
+    void setStrategyCache(StrategyCache* strategyCache) {
+        this->strategyCache = strategyCache;
+    }
+
+    virtual float computeEditDistance(Node<Data>* t1, Node<Data>* t2) override {
+        return computeBoundedEditDistance(t1, t2).distance;
+    }
+
+    float computeEditDistance(PreparedTree<Data>* t1, PreparedTree<Data>* t2) {
+        return computeBoundedEditDistance(t1, t2).distance;
+    }
+
+    // Like computeEditDistance(), but says whether a budget was exceeded and
+    // the distance is only an upper bound.
+    EditDistanceResult computeBoundedEditDistance(Node<Data>* t1, Node<Data>* t2) {
+        // Index the nodes of both input trees.
+        this->init(t1, t2);
+        return computeIndexedEditDistance();
+    }
+
+    EditDistanceResult computeBoundedEditDistance(PreparedTree<Data>* t1, PreparedTree<Data>* t2) {
+        // Both input trees are already indexed.
+        this->init(t1, t2);
+        return computeIndexedEditDistance();
+    }
+
+    // Number of subproblems computeEditDistance() would solve for the trees,
+    // as predicted by the optimal strategy [2, Section 5]. Identical trees
+    // cost 0. Computing the strategy takes O(size1 * size2) time and the
+    // memory of the delta matrix, a fraction of a distance computation, and
+    // like computeEditDistance() uses up this instance.
+    float predictCost(Node<Data>* t1, Node<Data>* t2) {
+        this->init(t1, t2);
+        return computeIndexedCost();
+    }
+
+    float predictCost(PreparedTree<Data>* t1, PreparedTree<Data>* t2) {
+        this->init(t1, t2);
+        return computeIndexedCost();
+    }
+
+    // Upper bound on predictCost() in O(size1 + size2), for ordering or
+    // filtering pairs before comparing them. Can be called any number of
+    // times.
+    float estimateCost(Node<Data>* t1, Node<Data>* t2) const {
+        NodeIndexer<Data> ni1(t1, this->costModel);
+        NodeIndexer<Data> ni2(t2, this->costModel);
+        return estimateIndexedCost(&ni1, &ni2);
+    }
+
+    float estimateCost(PreparedTree<Data>* t1, PreparedTree<Data>* t2) const {
+        return estimateIndexedCost(t1->getIndexer(), t2->getIndexer());
+    }
+
+    // Limits the memory of the delta matrix (size1 * size2 * sizeof(Cost)
+    // bytes) together with the largest single-path function tables it may need
+    // next to it (see getScratchBytes()), which can be larger still. Over
+    // budget, delta and the tables that don't fit are kept in memory-mapped
+    // temporary files, or computeEditDistance() returns an approximation or
+    // throws MemoryBudgetExceeded before doing any work. The strategy's own
+    // rows are not counted.
+    void setMemoryBudget(size_t bytes, BudgetPolicy policy) {
+        this->memoryBudget = bytes;
+        this->budgetPolicy = policy;
+    }
+
+    // Pairs whose strategy predicts more subproblems than this are not solved
+    // and get an approximate result. The prediction is exact for the
+    // single-path functions and costs O(size1 * size2) to compute, a small
+    // fraction of a large computation.
+    void setSubproblemBudget(float subproblems) {
+        this->subproblemBudget = subproblems;
+    }
+
+    // Computations still running this long after they started are abandoned
+    // for an approximate result. Only checked between single-path functions,
+    // so a single large one may overrun.
+    void setTimeBudget(std::chrono::steady_clock::duration timeBudget) {
+        this->hasTimeBudget = true;
+        this->timeBudget = timeBudget;
+    }
+
+    // Whether spfA keeps the forests of the right-hand tree in the fn and ft
+    // linked lists, as in the original implementation (the default), or walks
+    // the tree indexes instead [1, Section 8.4]. The latter needs no
+    // per-computation arrays and no list updates, but for inner paths it skips
+    // over the ancestors of the current node, which costs extra on deep trees.
+    // Both run at about the same speed on balanced trees.
+    void setInnerPathArrays(bool innerPathArrays) {
+        this->innerPathArrays = innerPathArrays;
+    }
+
+    // Optional, filled in by every computation. Only collected when compiled
+    // with CAPTED_STATS.
+    void setStats(AptedStats* stats) {
+        this->stats = stats;
+    }
+
+    // Number of subproblems (distances between subforests) computed by the
+    // single-path functions during the last computation.
+    long getSubproblemCount() const {
+        return counter;
+    }
+
+    // Number of subproblems the strategy of the last computation predicted,
+    // 0 if no strategy was needed.
+    float getPredictedSubproblemCount() const {
+        return predictedSubproblems;
     }
 };
 
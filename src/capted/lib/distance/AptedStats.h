@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// Apted Stats
+//------------------------------------------------------------------------------
+
+// Instrumentation is compiled in with -DCAPTED_STATS. Without it every
+// CAPTED_STATS_ONLY(...) statement disappears and a stats object passed to
+// Apted::setStats() stays zeroed.
+#ifdef CAPTED_STATS
+#define CAPTED_STATS_ONLY(...) __VA_ARGS__
+#else
+#define CAPTED_STATS_ONLY(...)
+#endif
+
+struct AptedStats {
+    // Shortcuts that skip the phases below
+    bool identicalTrees = false;
+    bool cachedResult = false;
+    bool cachedStrategy = false; // Only skips the strategy phase
+
+    // A budget was exceeded and the distance is an upper bound (see
+    // Apted::computeBoundedEditDistance())
+    bool approximate = false;
+
+    // Wall time of each phase in nanoseconds
+    long strategyNs = 0;
+    long initNs = 0;
+    long gtedNs = 0;
+
+    // Subproblems (distances between subforests) computed by each single-path
+    // function, and the number of pairs solved by spf1
+    long spfLSubproblems = 0;
+    long spfRSubproblems = 0;
+    long spfASubproblems = 0;
+    long spf1Calls = 0;
+
+    // Subproblems predicted by the strategy
+    double predictedSubproblems = 0;
+
+    // Path types of the strategy as used by gted, one per single-path function
+    // call
+    long leftPaths = 0;
+    long rightPaths = 0;
+    long innerPaths = 0;
+
+    // The delta matrix, and the most scratch memory (q, fn, ft and one
+    // single-path function's tables) in use at once while computing distances
+    size_t deltaBytes = 0;
+    size_t scratchBytes = 0;
+
+    // See Apted::setMemoryBudget(). peakBytes is the bound on delta and the
+    // scratch memory together that is compared against the budget.
+    size_t memoryBudget = 0;
+    size_t peakBytes = 0;
+    bool fileBackedDelta = false;
+    bool fileBackedTables = false;
+
+    long getTotalNs() const {
+        return strategyNs + initNs + gtedNs;
+    }
+
+    long getTotalSubproblems() const {
+        return spfLSubproblems + spfRSubproblems + spfASubproblems;
+    }
+
+    // Sums counters and times, keeps the larger memory figures
+    AptedStats &operator+=(const AptedStats &other) {
+        identicalTrees |= other.identicalTrees;
+        cachedResult |= other.cachedResult;
+        cachedStrategy |= other.cachedStrategy;
+        approximate |= other.approximate;
+        strategyNs += other.strategyNs;
+        initNs += other.initNs;
+        gtedNs += other.gtedNs;
+        spfLSubproblems += other.spfLSubproblems;
+        spfRSubproblems += other.spfRSubproblems;
+        spfASubproblems += other.spfASubproblems;
+        spf1Calls += other.spf1Calls;
+        predictedSubproblems += other.predictedSubproblems;
+        leftPaths += other.leftPaths;
+        rightPaths += other.rightPaths;
+        innerPaths += other.innerPaths;
+        deltaBytes = std::max(deltaBytes, other.deltaBytes);
+        scratchBytes = std::max(scratchBytes, other.scratchBytes);
+        memoryBudget = std::max(memoryBudget, other.memoryBudget);
+        peakBytes = std::max(peakBytes, other.peakBytes);
+        fileBackedDelta |= other.fileBackedDelta;
+        fileBackedTables |= other.fileBackedTables;
+        return *this;
+    }
+};
+
+inline long elapsedNs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline std::ostream &operator<<(std::ostream &os, AptedStats const &stats) {
+    os << "time " << stats.getTotalNs() / 1000000.0 << "ms"
+       << " (strategy " << stats.strategyNs / 1000000.0 << "ms"
+       << ", init " << stats.initNs / 1000000.0 << "ms"
+       << ", gted " << stats.gtedNs / 1000000.0 << "ms)"
+       << ", subproblems " << stats.getTotalSubproblems()
+       << " (predicted " << stats.predictedSubproblems
+       << ", spfL " << stats.spfLSubproblems
+       << ", spfR " << stats.spfRSubproblems
+       << ", spfA " << stats.spfASubproblems
+       << ", spf1 " << stats.spf1Calls << ")"
+       << ", paths L/R/I " << stats.leftPaths << "/" << stats.rightPaths << "/" << stats.innerPaths
+       << ", delta " << stats.deltaBytes << "B"
+       << ", scratch " << stats.scratchBytes << "B"
+       << ", peak bound " << stats.peakBytes << "B";
+
+    if (stats.identicalTrees) {
+        os << ", identical trees";
+    }
+    if (stats.cachedResult) {
+        os << ", cached";
+    }
+    if (stats.cachedStrategy) {
+        os << ", cached strategy";
+    }
+    if (stats.approximate) {
+        os << ", approximate";
+    }
+    if (stats.fileBackedDelta) {
+        os << ", file-backed delta (budget " << stats.memoryBudget << "B)";
+    }
+    if (stats.fileBackedTables) {
+        os << ", file-backed tables (budget " << stats.memoryBudget << "B)";
+    }
+
+    return os;
+}
+
+} // namespace capted
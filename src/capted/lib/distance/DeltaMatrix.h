@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// Memory Budget
+//------------------------------------------------------------------------------
+
+// What Apted does when the delta matrix of a pair, together with the largest
+// single-path function tables it may need next to it, is larger than its
+// memory budget
+enum class BudgetPolicy {
+    FILE_BACKED, // Keep delta and the tables that don't fit in memory-mapped temporary files
+    FAIL,        // Throw MemoryBudgetExceeded before computing anything
+    APPROXIMATE, // Return distance bounds without computing anything
+};
+
+class MemoryBudgetExceeded : public std::runtime_error {
+private:
+    static std::string makeMessage(size_t rows, size_t cols, size_t deltaBytes, size_t tableBytes, size_t budgetBytes) {
+        std::stringstream ss;
+        ss << "delta matrix of " << rows << "x" << cols << " entries needs "
+           << deltaBytes << " bytes";
+        if (tableBytes > 0) {
+            ss << " and the single-path tables up to " << tableBytes << " more, "
+               << deltaBytes + tableBytes << " bytes in total";
+        }
+        ss << ", over the budget of " << budgetBytes << " bytes";
+        return ss.str();
+    }
+
+public:
+    const size_t rows;
+    const size_t cols;
+    const size_t deltaBytes;
+    const size_t tableBytes;
+    const size_t requiredBytes; // deltaBytes + tableBytes
+    const size_t budgetBytes;
+
+    MemoryBudgetExceeded(size_t rows, size_t cols, size_t deltaBytes, size_t tableBytes, size_t budgetBytes)
+    : std::runtime_error(makeMessage(rows, cols, deltaBytes, tableBytes, budgetBytes))
+    , rows(rows)
+    , cols(cols)
+    , deltaBytes(deltaBytes)
+    , tableBytes(tableBytes)
+    , requiredBytes(deltaBytes + tableBytes)
+    , budgetBytes(budgetBytes) {
+        // nop
+    }
+};
+
+//------------------------------------------------------------------------------
+// Delta Matrix
+//------------------------------------------------------------------------------
+
+// Dense rows x cols matrix in one row-major block, indexed as delta[v][w].
+//
+// Rows and columns are in left-to-right preorder, so the entries of a pair of
+// subtrees form a run of consecutive row segments. gted and the single-path
+// functions work on one such pair at a time, which keeps their accesses
+// clustered whether the block lives on the heap or in a file mapping.
+//
+// The single-path functions keep their own tables in the same way, as they can
+// be as large as delta.
+template<class Cost>
+class DeltaMatrix {
+private:
+    size_t rows = 0;
+    size_t cols = 0;
+    std::vector<Cost> heap;
+    Cost* data = nullptr;
+    void* mapping = nullptr;
+    size_t mappingBytes = 0;
+
+    void release() {
+        if (mapping) {
+            munmap(mapping, mappingBytes);
+            mapping = nullptr;
+            mappingBytes = 0;
+        }
+
+        heap.clear();
+        heap.shrink_to_fit();
+        data = nullptr;
+        rows = 0;
+        cols = 0;
+    }
+
+    // The file is unlinked right away, so it disappears with the mapping even
+    // if the process is killed
+    void mapTemporaryFile(size_t bytes) {
+        const char* tmpDir = getenv("TMPDIR");
+        std::string path = std::string(tmpDir ? tmpDir : "/tmp") + "/capted-delta-XXXXXX";
+        std::vector<char> pathBuffer(path.begin(), path.end());
+        pathBuffer.push_back('\0');
+
+        int fd = mkstemp(pathBuffer.data());
+        if (fd == -1) {
+            throw std::runtime_error("cannot create delta file in " + path + ": " + strerror(errno));
+        }
+        unlink(pathBuffer.data());
+
+        if (ftruncate(fd, bytes) == -1) {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error(std::string("cannot size delta file: ") + strerror(error));
+        }
+
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        close(fd);
+        if (p == MAP_FAILED) {
+            throw std::runtime_error(std::string("cannot map delta file: ") + strerror(error));
+        }
+
+        mapping = p;
+        mappingBytes = bytes;
+        data = (Cost*) p;
+    }
+
+public:
+    DeltaMatrix() {
+        // nop
+    }
+
+    DeltaMatrix(const DeltaMatrix &other) = delete;
+    DeltaMatrix &operator=(const DeltaMatrix &other) = delete;
+
+    ~DeltaMatrix() {
+        release();
+    }
+
+    static size_t getBytes(size_t rows, size_t cols) {
+        return rows * cols * sizeof(Cost);
+    }
+
+    // All entries start at 0
+    void allocate(size_t rows, size_t cols, size_t budgetBytes, BudgetPolicy policy) {
+        release();
+
+        size_t bytes = getBytes(rows, cols);
+        if (bytes > budgetBytes) {
+            if (policy != BudgetPolicy::FILE_BACKED) {
+                throw MemoryBudgetExceeded(rows, cols, bytes, 0, budgetBytes);
+            }
+            mapTemporaryFile(bytes);
+        } else {
+            heap.resize(rows * cols);
+            data = heap.data();
+        }
+
+        this->rows = rows;
+        this->cols = cols;
+    }
+
+    // Number of rows, 0 before allocate()
+    size_t size() const {
+        return rows;
+    }
+
+    bool isFileBacked() const {
+        return mapping != nullptr;
+    }
+
+    // What the matrix takes from the heap, 0 if file-backed
+    size_t getHeapBytes() const {
+        return heap.size() * sizeof(Cost);
+    }
+
+    Cost* operator[](size_t row) {
+        return data + row * cols;
+    }
+
+    const Cost* operator[](size_t row) const {
+        return data + row * cols;
+    }
+};
+
+} // namespace capted
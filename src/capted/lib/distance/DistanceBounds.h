@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// Distance Bounds
+//------------------------------------------------------------------------------
+
+// Result of Apted::computeBoundedEditDistance(). An exact distance has all
+// three values equal. An approximate one, returned when a budget is exceeded,
+// reports the upper bound as the distance.
+struct EditDistanceResult {
+    float distance;
+    float lowerBound;
+    float upperBound;
+    bool approximate;
+};
+
+// Cheap lower bounds on the unit cost tree edit distance (see
+// CostModel::isUnitCost()). Labels are given as CostModel::labelHash() values;
+// hash collisions can only make the bounds smaller.
+
+typedef std::vector<std::pair<uint64_t, int>> LabelHistogram;
+
+// Label counts sorted by label
+inline LabelHistogram makeLabelHistogram(std::vector<uint64_t> labels) {
+    LabelHistogram histogram;
+    std::sort(labels.begin(), labels.end());
+
+    for (uint64_t label : labels) {
+        if (histogram.empty() || histogram.back().first != label) {
+            histogram.push_back(std::make_pair(label, 0));
+        }
+        histogram.back().second++;
+    }
+
+    return histogram;
+}
+
+// Half the L1 distance between the histograms, rounded up. Every edit
+// operation changes the histogram by at most 2.
+inline int histogramDistance(const LabelHistogram &h1, const LabelHistogram &h2) {
+    int l1 = 0;
+    auto it1 = h1.begin();
+    auto it2 = h2.begin();
+
+    while (it1 != h1.end() && it2 != h2.end()) {
+        if (it1->first < it2->first) {
+            l1 += (it1++)->second;
+        } else if (it2->first < it1->first) {
+            l1 += (it2++)->second;
+        } else {
+            l1 += std::abs((it1++)->second - (it2++)->second);
+        }
+    }
+    for (; it1 != h1.end(); it1++) {
+        l1 += it1->second;
+    }
+    for (; it2 != h2.end(); it2++) {
+        l1 += it2->second;
+    }
+
+    return (l1 + 1) / 2;
+}
+
+// Unit cost string edit distance, or k + 1 if it is greater than k. Applied to
+// the preorder or postorder label sequences of two trees it is a lower bound on
+// their edit distance. Only cells within k of the diagonal are computed; the
+// others are at least k + 1 anyway.
+inline int boundedStringDistance(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b, int k) {
+    int n = a.size();
+    int m = b.size();
+    const int inf = k + 1;
+
+    if (std::abs(n - m) > k) {
+        return inf;
+    }
+
+    std::vector<int> prev(m + 1, inf);
+    std::vector<int> curr(m + 1, inf);
+    for (int j = 0; j <= std::min(m, k); j++) {
+        prev[j] = j;
+    }
+
+    for (int i = 1; i <= n; i++) {
+        int lo = std::max(1, i - k);
+        int hi = std::min(m, i + k);
+
+        curr[lo - 1] = (lo == 1 && i <= k) ? i : inf;
+        int rowMin = curr[lo - 1];
+
+        for (int j = lo; j <= hi; j++) {
+            int d = std::min(prev[j] + 1, curr[j - 1] + 1);
+            d = std::min(d, prev[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1));
+            curr[j] = std::min(d, inf);
+            rowMin = std::min(rowMin, curr[j]);
+        }
+
+        // The next row reads one cell past the band
+        if (hi < m) {
+            curr[hi + 1] = inf;
+        }
+
+        if (rowMin >= inf) {
+            return inf;
+        }
+
+        std::swap(prev, curr);
+    }
+
+    return std::min(prev[m], inf);
+}
+
+} // namespace capted
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "util/LruCache.h"
+#include "util/hash.h"
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// Strategy Cache
+//------------------------------------------------------------------------------
+
+struct StrategyCacheKey {
+    uint64_t shape1;
+    uint64_t shape2;
+    int size1;
+    int size2;
+
+    bool operator==(const StrategyCacheKey &other) const {
+        return shape1 == other.shape1 &&
+               shape2 == other.shape2 &&
+               size1  == other.size1 &&
+               size2  == other.size2;
+    }
+};
+
+struct StrategyCacheKeyHash {
+    size_t operator()(const StrategyCacheKey &key) const {
+        uint64_t hash = hashCombine(key.shape1, key.shape2);
+        return hashCombine(hash, ((uint64_t)key.size1 << 32) | (uint32_t)key.size2);
+    }
+};
+
+struct StrategyCacheEntry {
+    float cost; // See Apted::predictCost()
+
+    // Subtree sizes of both trees in preorder (NodeIndexer::sizes), which
+    // determine their shapes. A hit is only used if they match, since the
+    // shape hashes can collide.
+    std::vector<int> sizes1;
+    std::vector<int> sizes2;
+
+    // size1*size2 row-major copy of the strategy path ids in delta
+    std::vector<int> strategy;
+
+    size_t getBytes() const {
+        return sizeof(StrategyCacheEntry) + (sizes1.size() + sizes2.size() + strategy.size()) * sizeof(int);
+    }
+};
+
+/**
+ * Bounded LRU cache of computed strategies that can be shared by any number of
+ * Apted instances, including ones running on different threads.
+ *
+ * <p>The strategy [2, Section 5] only depends on the shapes of the two trees,
+ * not on their labels or the cost model. Entries are keyed by the shape hashes
+ * of both trees (see NodeIndexer::shapeHash) and their sizes, so pairs of
+ * differently labelled trees with the same shapes share one entry, and a hit
+ * replaces the strategy computation by a copy into the delta matrix.
+ */
+
+class StrategyCache : public LruCache<StrategyCacheKey, StrategyCacheEntry, StrategyCacheKeyHash> {
+public:
+    typedef StrategyCacheKey Key;
+    typedef StrategyCacheEntry Entry;
+
+    // Smaller strategies are cheaper to recompute than to look up.
+    static const int MIN_PAIRS = 256;
+
+    StrategyCache(size_t capacityBytes) : LruCache(capacityBytes) {
+        // nop
+    }
+
+    // Entries larger than this would flush most of the cache for one pair.
+    bool accepts(int size1, int size2) const {
+        long pairs = (long)size1 * (long)size2;
+        return pairs >= MIN_PAIRS && pairs * sizeof(int) <= getCapacityBytes() / 8;
+    }
+
+    // Keeps the existing entry: either a concurrent computation of the same
+    // shapes, which has the same strategy, or the shapes of a hash collision.
+    void insert(const Key &key, std::shared_ptr<const Entry> entry) {
+        insertEntry(key, entry, false);
+    }
+};
+
+} // namespace capted
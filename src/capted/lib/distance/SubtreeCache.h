@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "util/LruCache.h"
+#include "util/hash.h"
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// Subtree Cache
+//------------------------------------------------------------------------------
+
+struct SubtreeCacheKey {
+    uint64_t hash1;
+    uint64_t hash2;
+    uint64_t modelId;
+    int size1;
+    int size2;
+
+    bool operator==(const SubtreeCacheKey &other) const {
+        return hash1   == other.hash1 &&
+               hash2   == other.hash2 &&
+               modelId == other.modelId &&
+               size1   == other.size1 &&
+               size2   == other.size2;
+    }
+};
+
+struct SubtreeCacheKeyHash {
+    size_t operator()(const SubtreeCacheKey &key) const {
+        uint64_t hash = hashCombine(key.hash1, key.hash2);
+        hash = hashCombine(hash, key.modelId);
+        return hashCombine(hash, ((uint64_t)key.size1 << 32) | (uint32_t)key.size2);
+    }
+};
+
+struct SubtreeCacheEntry {
+    float distance;
+
+    // size1*size2 row-major copy of the delta block. Empty for pairs of
+    // whole trees since nothing reads their block afterwards; such entries
+    // only answer lookups for whole trees.
+    std::vector<float> delta;
+
+    size_t getBytes() const {
+        return sizeof(SubtreeCacheEntry) + delta.size() * sizeof(float);
+    }
+};
+
+/**
+ * Bounded LRU cache of solved subtree pairs that can be shared by any number of
+ * Apted instances, including ones running on different threads.
+ *
+ * <p>Entries are keyed by the Merkle hashes of both subtrees (see
+ * NodeIndexer::preL_to_hash), their sizes and the cost model id. An entry holds
+ * the distance between the subtrees plus the block of the delta matrix that
+ * Apted::gted fills for the pair, so a hit replaces the whole recursion below
+ * that pair by a copy.
+ */
+
+class SubtreeCache : public LruCache<SubtreeCacheKey, SubtreeCacheEntry, SubtreeCacheKeyHash> {
+public:
+    typedef SubtreeCacheKey Key;
+    typedef SubtreeCacheEntry Entry;
+
+    // Blocks smaller than this are cheaper to recompute than to look up.
+    static const int MIN_SUBPROBLEMS = 64;
+
+    SubtreeCache(size_t capacityBytes) : LruCache(capacityBytes) {
+        // nop
+    }
+
+    // Entries larger than this would flush most of the cache for one pair.
+    bool accepts(int size1, int size2) const {
+        long subproblems = (long)size1 * (long)size2;
+        return subproblems >= MIN_SUBPROBLEMS && subproblems * sizeof(float) <= getCapacityBytes() / 8;
+    }
+
+    // Replaces the existing entry, which is either a concurrent solve of the
+    // same pair or a distance-only entry being upgraded with its block.
+    void insert(const Key &key, std::shared_ptr<const Entry> entry) {
+        insertEntry(key, entry, true);
+    }
+};
+
+} // namespace capted
@@ -2,6 +2,7 @@
 
 #include "CostModel.h"
 #include "node/NodeIndexer.h"
+#include "node/PreparedTree.h"
 
 namespace capted {
 
@@ -16,6 +17,7 @@ class TreeEditDistance {
 protected:
     NodeIndexer<Data>* it1;
     NodeIndexer<Data>* it2;
+    bool ownsIndexers;
     int size1;
     int size2;
     const CostModel<Data>* costModel;
@@ -23,6 +25,18 @@ protected:
     void init(Node<Data>* t1, Node<Data>* t2) {
         it1 = new NodeIndexer<Data>(t1, costModel);
         it2 = new NodeIndexer<Data>(t2, costModel);
+        ownsIndexers = true;
+        size1 = it1->getSize();
+        size2 = it2->getSize();
+    }
+
+    void init(PreparedTree<Data>* t1, PreparedTree<Data>* t2) {
+        assert(t1->getCostModel() == costModel);
+        assert(t2->getCostModel() == costModel);
+
+        it1 = t1->getIndexer();
+        it2 = t2->getIndexer();
+        ownsIndexers = false;
         size1 = it1->getSize();
         size2 = it2->getSize();
     }
@@ -31,13 +45,16 @@ public:
     TreeEditDistance(CostModel<Data>* costModel) : costModel(costModel) {
         it1 = nullptr;
         it2 = nullptr;
+        ownsIndexers = false;
         size1 = -1;
         size2 = -1;
     }
 
     ~TreeEditDistance() {
-        delete it1;
-        delete it2;
+        if (ownsIndexers) {
+            delete it1;
+            delete it2;
+        }
     }
 
     virtual float computeEditDistance(Node<Data>* t1, Node<Data>* t2) = 0;
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "CostModel.h"
+#include "distance/Apted.h"
+#include "distance/DistanceBounds.h"
+#include "distance/StrategyCache.h"
+#include "distance/SubtreeCache.h"
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// Similarity Join
+//------------------------------------------------------------------------------
+
+/**
+ * Finds every pair of trees whose edit distance is at most tau, either within
+ * one collection (self join) or between two collections (R x S join).
+ *
+ * <p>Pairs go through a filter-then-verify pipeline. For unit cost models
+ * (CostModel::isUnitCost()) three lower bounds on the edit distance discard
+ * most pairs cheaply, in increasing order of cost:
+ * <ol>
+ * <li>The difference in node counts.
+ * <li>Half the L1 distance between the label histograms, since every edit
+ *     operation changes the histogram by at most 2.
+ * <li>The string edit distance between the preorder and between the postorder
+ *     label sequences [1]. It is computed in a band of width tau so that a
+ *     pair costs O(n * tau) instead of O(n^2).
+ * </ol>
+ * The remaining candidates are verified with Apted, spread across threads. For
+ * other cost models every pair is verified.
+ *
+ * <p>References:
+ * <ul>
+ * <li>[1] S. Guha, H. V. Jagadish, N. Koudas, D. Srivastava, T. Yu. Approximate
+ *      XML Joins. SIGMOD 2002.
+ * </ul>
+ *
+ * <p>The cost model is used by all verification threads at once and must not
+ * modify any state in its cost functions.
+ */
+
+template<class Data>
+class SimilarityJoin {
+public:
+    struct Match {
+        int first;  // Index into the first (or only) collection
+        int second; // Index into the second (or the same) collection
+        float distance;
+
+        bool operator<(const Match &other) const {
+            return std::make_pair(first, second) < std::make_pair(other.first, other.second);
+        }
+    };
+
+    struct Stats {
+        long pairs = 0;
+        long sizeFiltered = 0;
+        long histogramFiltered = 0;
+        long traversalFiltered = 0;
+        long verified = 0;
+        long matches = 0;
+    };
+
+private:
+    // Per-tree data for the filters, computed once per join
+    struct Signature {
+        int size;
+        LabelHistogram histogram;
+        std::vector<uint64_t> preorder;
+        std::vector<uint64_t> postorder;
+    };
+
+    CostModel<Data>* costModel;
+    float tau;
+    int numThreads;
+    SubtreeCache* subtreeCache = nullptr;
+    StrategyCache* strategyCache = nullptr;
+    Stats stats;
+
+    Signature makeSignature(Node<Data>* root) const {
+        Signature sig;
+
+        std::function<void(Node<Data>*)> traverse = [&](Node<Data>* node) -> void {
+            uint64_t label = costModel->labelHash(node);
+            sig.preorder.push_back(label);
+            for (Node<Data>* child : node->getChildren()) {
+                traverse(child);
+            }
+            sig.postorder.push_back(label);
+        };
+        traverse(root);
+
+        sig.size = sig.preorder.size();
+        sig.histogram = makeLabelHistogram(sig.preorder);
+
+        return sig;
+    }
+
+    // Whether the pair can still be within tau after the filters
+    bool isCandidate(const Signature &s1, const Signature &s2) {
+        stats.pairs++;
+
+        if (!costModel->isUnitCost()) {
+            return true;
+        }
+
+        if (std::abs(s1.size - s2.size) > tau) {
+            stats.sizeFiltered++;
+            return false;
+        }
+
+        if (histogramDistance(s1.histogram, s2.histogram) > tau) {
+            stats.histogramFiltered++;
+            return false;
+        }
+
+        int k = std::floor(tau);
+        if (boundedStringDistance(s1.preorder, s2.preorder, k) > k || boundedStringDistance(s1.postorder, s2.postorder, k) > k) {
+            stats.traversalFiltered++;
+            return false;
+        }
+
+        return true;
+    }
+
+    std::vector<Match> verify(const std::vector<Match> &candidates, const std::vector<Node<Data>*> &r, const std::vector<Node<Data>*> &s) {
+        std::atomic<size_t> next(0);
+        std::vector<std::vector<Match>> results(numThreads);
+
+        // Every pair gets its own Apted instance (and indexers) since Apted
+        // keeps traversal state in them while it runs
+        auto worker = [&](int threadId) -> void {
+            size_t i;
+            while ((i = next++) < candidates.size()) {
+                Match match = candidates[i];
+                Apted<Data> algorithm(costModel);
+                algorithm.setSubtreeCache(subtreeCache);
+                algorithm.setStrategyCache(strategyCache);
+                match.distance = algorithm.computeEditDistance(r[match.first], s[match.second]);
+
+                if (match.distance <= tau) {
+                    results[threadId].push_back(match);
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int t = 1; t < numThreads; t++) {
+            threads.push_back(std::thread(worker, t));
+        }
+        worker(0);
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+
+        std::vector<Match> matches;
+        for (std::vector<Match> &result : results) {
+            matches.insert(matches.end(), result.begin(), result.end());
+        }
+        std::sort(matches.begin(), matches.end());
+
+        stats.verified += candidates.size();
+        stats.matches += matches.size();
+        return matches;
+    }
+
+public:
+    SimilarityJoin(CostModel<Data>* costModel, float tau, int numThreads = std::thread::hardware_concurrency())
+    : costModel(costModel)
+    , tau(tau)
+    , numThreads(std::max(1, numThreads)) {
+        // nop
+    }
+
+    // Optional, shared by all verification threads
+    void setSubtreeCache(SubtreeCache* subtreeCache) {
+        this->subtreeCache = subtreeCache;
+    }
+
+    // Optional, shared by all verification threads. Pays off when many trees
+    // have the same shape, e.g. generated or templated documents.
+    void setStrategyCache(StrategyCache* strategyCache) {
+        this->strategyCache = strategyCache;
+    }
+
+    // Pairs (i, j) with i < j, sorted
+    std::vector<Match> selfJoin(const std::vector<Node<Data>*> &trees) {
+        std::vector<Signature> sigs;
+        for (Node<Data>* tree : trees) {
+            sigs.push_back(makeSignature(tree));
+        }
+
+        std::vector<Match> candidates;
+        for (size_t i = 0; i < trees.size(); i++) {
+            for (size_t j = i + 1; j < trees.size(); j++) {
+                if (isCandidate(sigs[i], sigs[j])) {
+                    candidates.push_back({(int)i, (int)j, 0.0f});
+                }
+            }
+        }
+
+        return verify(candidates, trees, trees);
+    }
+
+    // Pairs (i, j) of r[i] and s[j], sorted
+    std::vector<Match> join(const std::vector<Node<Data>*> &r, const std::vector<Node<Data>*> &s) {
+        std::vector<Signature> rSigs;
+        for (Node<Data>* tree : r) {
+            rSigs.push_back(makeSignature(tree));
+        }
+
+        std::vector<Signature> sSigs;
+        for (Node<Data>* tree : s) {
+            sSigs.push_back(makeSignature(tree));
+        }
+
+        std::vector<Match> candidates;
+        for (size_t i = 0; i < r.size(); i++) {
+            for (size_t j = 0; j < s.size(); j++) {
+                if (isCandidate(rSigs[i], sSigs[j])) {
+                    candidates.push_back({(int)i, (int)j, 0.0f});
+                }
+            }
+        }
+
+        return verify(candidates, r, s);
+    }
+
+    // Accumulated over all joins run by this instance
+    const Stats &getStats() const {
+        return stats;
+    }
+};
+
+} // namespace capted
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <random>
+#include <vector>
+#include "node/PreparedTree.h"
+#include "distance/Apted.h"
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// Vantage Point Tree
+//------------------------------------------------------------------------------
+
+/**
+ * Metric index over prepared trees using the tree edit distance as the metric.
+ * Answers k-nearest-neighbour and range queries with far fewer distance
+ * computations than comparing the query against every tree.
+ *
+ * <p>Each node picks a vantage point and splits the remaining trees at the
+ * median distance mu from it. A query at distance d from the vantage point
+ * only has to visit the side(s) that intersect the ball of radius tau around
+ * it, where tau is the best distance found so far (k-th best for kNN queries,
+ * fixed radius for range queries). This pruning relies on the triangle
+ * inequality, so the cost model has to be a metric (CostModel::isMetric()).
+ *
+ * <p>References:
+ * <ul>
+ * <li>[1] P. N. Yianilos. Data Structures and Algorithms for Nearest Neighbor
+ *      Search in General Metric Spaces. SODA 1993.
+ * </ul>
+ *
+ * <p>The indexed trees are not owned. Results refer to trees by their position
+ * in the vector passed to the constructor.
+ */
+
+template<class Data>
+class VPTree {
+public:
+    struct Neighbour {
+        int id;
+        float distance;
+
+        bool operator<(const Neighbour &other) const {
+            return distance < other.distance;
+        }
+    };
+
+private:
+    // Subtrees with at most this many trees are scanned linearly.
+    static const int BUCKET_SIZE = 4;
+
+    struct VPNode {
+        int vantagePoint;
+        float mu;
+        int inside;  // Trees with distance <= mu, index into nodes or -1
+        int outside; // Trees with distance > mu, index into nodes or -1
+        std::vector<int> bucket;
+    };
+
+    CostModel<Data>* costModel;
+    std::vector<PreparedTree<Data>*> trees;
+    std::vector<VPNode> nodes;
+    int rootNode;
+    long distanceCount;
+
+    float distance(PreparedTree<Data>* t1, PreparedTree<Data>* t2) {
+        distanceCount++;
+        Apted<Data> algorithm(costModel);
+        return algorithm.computeEditDistance(t1, t2);
+    }
+
+    int build(std::vector<int> &ids, int begin, int end, std::mt19937 &rng) {
+        if (begin >= end) {
+            return -1;
+        }
+
+        int nodeId = nodes.size();
+        nodes.push_back(VPNode());
+        nodes[nodeId].inside = -1;
+        nodes[nodeId].outside = -1;
+        nodes[nodeId].mu = 0.0f;
+
+        if (end - begin <= BUCKET_SIZE) {
+            nodes[nodeId].vantagePoint = -1;
+            nodes[nodeId].bucket.assign(ids.begin() + begin, ids.begin() + end);
+            return nodeId;
+        }
+
+        // Random vantage point, moved to the front of the range
+        std::swap(ids[begin], ids[begin + rng() % (end - begin)]);
+        int vantagePoint = ids[begin];
+
+        std::vector<Neighbour> others;
+        others.reserve(end - begin - 1);
+        for (int i = begin + 1; i < end; i++) {
+            others.push_back({ids[i], distance(trees[vantagePoint], trees[ids[i]])});
+        }
+
+        int median = others.size() / 2;
+        std::nth_element(others.begin(), others.begin() + median, others.end());
+        float mu = others[median].distance;
+
+        // Keep trees at exactly mu on the inside so that the split matches the
+        // search conditions below
+        auto split = std::partition(others.begin(), others.end(), [mu](const Neighbour &n) -> bool {
+            return n.distance <= mu;
+        });
+
+        for (size_t i = 0; i < others.size(); i++) {
+            ids[begin + 1 + i] = others[i].id;
+        }
+
+        int splitPos = begin + 1 + (split - others.begin());
+        int inside = build(ids, begin + 1, splitPos, rng);
+        int outside = build(ids, splitPos, end, rng);
+
+        nodes[nodeId].vantagePoint = vantagePoint;
+        nodes[nodeId].mu = mu;
+        nodes[nodeId].inside = inside;
+        nodes[nodeId].outside = outside;
+        return nodeId;
+    }
+
+    // Visits every tree that may be closer than the current bound. The bound
+    // is read through the callback each time so that kNN queries can tighten
+    // it while searching.
+    template<class Visit, class Bound>
+    void search(int nodeId, PreparedTree<Data>* query, Visit visit, Bound bound) {
+        if (nodeId == -1) {
+            return;
+        }
+
+        const VPNode &node = nodes[nodeId];
+        if (node.vantagePoint == -1) {
+            for (int id : node.bucket) {
+                visit(id, distance(query, trees[id]));
+            }
+            return;
+        }
+
+        float d = distance(query, trees[node.vantagePoint]);
+        visit(node.vantagePoint, d);
+
+        // Search the side the query falls in first; it is more likely to
+        // tighten the bound before the other side is checked.
+        if (d <= node.mu) {
+            if (d - bound() <= node.mu) {
+                search(node.inside, query, visit, bound);
+            }
+            if (d + bound() > node.mu) {
+                search(node.outside, query, visit, bound);
+            }
+        } else {
+            if (d + bound() > node.mu) {
+                search(node.outside, query, visit, bound);
+            }
+            if (d - bound() <= node.mu) {
+                search(node.inside, query, visit, bound);
+            }
+        }
+    }
+
+public:
+    VPTree(const std::vector<PreparedTree<Data>*> &trees, CostModel<Data>* costModel, unsigned int seed = 0)
+    : costModel(costModel)
+    , trees(trees)
+    , rootNode(-1)
+    , distanceCount(0) {
+        assert(costModel->isMetric());
+
+        std::vector<int> ids(trees.size());
+        for (size_t i = 0; i < ids.size(); i++) {
+            assert(trees[i]->getCostModel() == costModel);
+            ids[i] = i;
+        }
+
+        std::mt19937 rng(seed);
+        rootNode = build(ids, 0, ids.size(), rng);
+    }
+
+    // The k closest trees sorted by distance. Trees further than bound (e.g.
+    // the best distance found by an earlier query) are never returned, which
+    // also lets the search prune from the start.
+    std::vector<Neighbour> knn(PreparedTree<Data>* query, int k, float bound = std::numeric_limits<float>::infinity()) {
+        std::priority_queue<Neighbour> best; // Max-heap, worst of the k best on top
+
+        if (k > 0) {
+            search(rootNode, query, [&](int id, float d) -> void {
+                if (d > bound) {
+                    return;
+                }
+                if ((int)best.size() < k) {
+                    best.push({id, d});
+                } else if (d < best.top().distance) {
+                    best.pop();
+                    best.push({id, d});
+                }
+            }, [&]() -> float {
+                return ((int)best.size() < k) ? bound : std::min(bound, best.top().distance);
+            });
+        }
+
+        std::vector<Neighbour> result;
+        while (!best.empty()) {
+            result.push_back(best.top());
+            best.pop();
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    // Every tree within radius of the query, sorted by distance.
+    std::vector<Neighbour> range(PreparedTree<Data>* query, float radius) {
+        std::vector<Neighbour> result;
+
+        search(rootNode, query, [&](int id, float d) -> void {
+            if (d <= radius) {
+                result.push_back({id, d});
+            }
+        }, [&]() -> float {
+            return radius;
+        });
+
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    int getSize() const {
+        return trees.size();
+    }
+
+    // Number of edit distances computed so far, including while building.
+    long getDistanceCount() const {
+        return distanceCount;
+    }
+};
+
+} // namespace capted
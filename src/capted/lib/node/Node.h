@@ -5,9 +5,90 @@
 #include <algorithm>
 #include <functional>
 #include <cassert>
+#include <type_traits>
+#include <utility>
 
 namespace capted {
 
+//------------------------------------------------------------------------------
+// Node Storage
+//------------------------------------------------------------------------------
+
+// How a node holds its data. Data that is not polymorphic, such as
+// StringNodeData, is stored inside the node, so that a node is a single
+// allocation and copying one copies its data by value.
+//
+// Polymorphic data is owned through a pointer and copied by a cloneData()
+// function found by argument-dependent lookup, so it still costs a node two
+// allocations and a clone one virtual call per node. This includes the
+// AutoMarker's SimpleStatement trees, which gain nothing from this storage.
+template<class Data, bool OnHeap = std::is_polymorphic<Data>::value>
+class NodeStorage;
+
+template<class Data>
+class NodeStorage<Data, true> {
+private:
+    Data* data;
+
+public:
+    explicit NodeStorage(Data* data) : data(data) {
+        // nop
+    }
+
+    NodeStorage(NodeStorage &&other) : data(other.data) {
+        other.data = nullptr;
+    }
+
+    NodeStorage(const NodeStorage &other) = delete;
+    NodeStorage &operator=(const NodeStorage &other) = delete;
+
+    ~NodeStorage() {
+        delete data;
+    }
+
+    Data* get() const {
+        return data;
+    }
+
+    NodeStorage clone() const {
+        return NodeStorage(cloneData(data));
+    }
+};
+
+template<class Data>
+class NodeStorage<Data, false> {
+private:
+    // Nodes hand out non-const data from const getters
+    mutable Data data;
+
+public:
+    // Takes over heap allocated data, for code written against the pointer
+    // form. Prefer constructing nodes from a value.
+    explicit NodeStorage(Data* data) : data(std::move(*data)) {
+        delete data;
+    }
+
+    explicit NodeStorage(Data &&data) : data(std::move(data)) {
+        // nop
+    }
+
+    explicit NodeStorage(const Data &data) : data(data) {
+        // nop
+    }
+
+    NodeStorage(NodeStorage &&other) = default;
+    NodeStorage(const NodeStorage &other) = delete;
+    NodeStorage &operator=(const NodeStorage &other) = delete;
+
+    Data* get() const {
+        return &data;
+    }
+
+    NodeStorage clone() const {
+        return NodeStorage(static_cast<const Data &>(data));
+    }
+};
+
 //------------------------------------------------------------------------------
 // Node
 //------------------------------------------------------------------------------
@@ -15,18 +96,41 @@ namespace capted {
 template<class Data>
 class Node {
 private:
-    Data* data;
+    NodeStorage<Data> storage;
     Node<Data>* parent;
     std::list<Node<Data>*> children;
 
+    Node(NodeStorage<Data> &&storage) : storage(std::move(storage)), parent(nullptr) {
+        // nop
+    }
+
 public:
-    Node(Data* data) : data(data), parent(nullptr) {
+    // Takes ownership of data
+    Node(Data* data) : storage(data), parent(nullptr) {
         // nop
     }
 
-    virtual ~Node() {
-        delete data;
+    // Stores data in the node. Only available for data that is not
+    // polymorphic, see NodeStorage.
+    template<class D, class = typename std::enable_if<std::is_same<typename std::decay<D>::type, Data>::value && !std::is_polymorphic<Data>::value>::type>
+    explicit Node(D &&data) : storage(std::forward<D>(data)), parent(nullptr) {
+        // nop
+    }
+
+    // Takes the data and children of a detached node, leaving it empty
+    Node(Node<Data> &&other) : storage(std::move(other.storage)), parent(nullptr), children(std::move(other.children)) {
+        assert(!other.parent);
+        other.children.clear();
 
+        for (Node<Data>* c : children) {
+            c->parent = this;
+        }
+    }
+
+    Node(const Node<Data> &other) = delete;
+    Node<Data> &operator=(const Node<Data> &other) = delete;
+
+    virtual ~Node() {
         for (Node<Data>* c : children) {
             delete c;
         }
@@ -37,7 +141,7 @@ public:
     //-------------------------------------------------------------------------
 
     Node<Data>* clone() {
-        auto copy = new Node<Data>(cloneData(data));
+        auto copy = new Node<Data>(storage.clone());
 
         for (Node<Data>* child : children) {
             copy->addChild(child->clone());
@@ -97,7 +201,7 @@ public:
     //-------------------------------------------------------------------------
 
     Data* getData() const {
-        return data;
+        return storage.get();
     }
 
     int getNodeCount() const {
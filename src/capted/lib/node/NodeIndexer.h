@@ -2,7 +2,9 @@
 
 #include <vector>
 #include <iostream>
+#include <cstdint>
 #include "util/debug.h"
+#include "util/hash.h"
 
 namespace capted {
 
@@ -43,16 +45,21 @@ namespace capted {
 template <class NodeData>
 class AllPossibleMappings;
 
-template <class NodeData>
+template <class NodeData, class Cost>
 class Apted;
 
+template <class NodeData>
+class PreparedTree;
+
 template<class Data>
 class NodeIndexer {
 private:
     typedef Node<Data> N;
 
     friend AllPossibleMappings<Data>;
-    friend Apted<Data>;
+    template <class NodeData, class Cost>
+    friend class Apted;
+    friend PreparedTree<Data>;
 
     const CostModel<Data>* costModel;
     const int treeSize;
@@ -86,6 +93,14 @@ private:
     std::vector<float> preL_to_sumDelCost;
     std::vector<float> preL_to_sumInsCost;
 
+    // Merkle hash of every subtree under the cost model's label equality.
+    // Only filled when CostModel::hasZeroSelfRenameCost() is true.
+    std::vector<uint64_t> preL_to_hash;
+
+    // Hash of the shape of the whole tree, ignoring labels. The strategy only
+    // depends on the shapes of both trees (see StrategyCache).
+    uint64_t shapeHash;
+
     // Temp variables
     int currentNode;
     int lchl;
@@ -95,6 +110,7 @@ private:
     int krSizesSumTmp;
     int revkrSizesSumTmp;
     int preorderTmp;
+    uint64_t shapeHashTmp;
 
     int indexNodes(N* node, int postorder) {
         // Initialise variables.
@@ -106,6 +122,7 @@ private:
         int preorder = preorderTmp;
         int preorderR = 0;
         int currentPreorder = -1;
+        uint64_t currentShapeHash = 0;
 
         // Store the preorder id of the current node to use it after the recursion.
         preorderTmp++;
@@ -123,6 +140,7 @@ private:
 
             currentSize += 1 + sizeTmp;
             descSizes += descSizesTmp;
+            currentShapeHash = hashCombine(currentShapeHash, shapeHashTmp);
 
             if(childrenCount > 1) {
                 krSizesSum += krSizesSumTmp + sizeTmp + 1;
@@ -149,6 +167,15 @@ private:
         // Store pointer to a node object corresponding to preorder.
         preL_to_node[preorder] = node;
 
+        // Children are indexed by now so the subtree hash can be built bottom-up.
+        if (costModel->hasZeroSelfRenameCost()) {
+            uint64_t hash = costModel->labelHash(node);
+            for (int child : children[preorder]) {
+                hash = hashCombine(hash, preL_to_hash[child]);
+            }
+            preL_to_hash[preorder] = hashCombine(hash, children[preorder].size());
+        }
+
         sizes[preorder] = currentSize + 1;
         preorderR = treeSize - 1 - postorder;
         preL_to_preR[preorder] = preorderR;
@@ -158,6 +185,7 @@ private:
         sizeTmp = currentSize;
         krSizesSumTmp = krSizesSum;
         revkrSizesSumTmp = revkrSizesSum;
+        shapeHashTmp = hashCombine(currentShapeHash, childrenCount);
 
         postL_to_preL[postorder] = preorder;
         preL_to_postL[preorder] = postorder;
@@ -250,6 +278,7 @@ public:
         krSizesSumTmp = 0;
         revkrSizesSumTmp = 0;
         preorderTmp = 0;
+        shapeHashTmp = 0;
 
         // Initialize indices
         sizes.resize(treeSize, 0);
@@ -277,10 +306,12 @@ public:
         preL_to_desc_sum.resize(treeSize, 0);
         preL_to_sumDelCost.resize(treeSize, 0.0f);
         preL_to_sumInsCost.resize(treeSize, 0.0f);
+        preL_to_hash.resize(treeSize, 0);
 
         // Index
         indexNodes(inputTree, -1);
         postTraversalIndexing();
+        shapeHash = shapeHashTmp;
     }
 
     int getSize() {
@@ -334,6 +365,7 @@ public:
         std::cerr << "preL_to_desc_sum: "   << arrayToString(preL_to_desc_sum)   << std::endl;
         std::cerr << "preL_to_sumDelCost: " << arrayToString(preL_to_sumDelCost) << std::endl;
         std::cerr << "preL_to_sumInsCost: " << arrayToString(preL_to_sumInsCost) << std::endl;
+        std::cerr << "preL_to_hash: "       << arrayToString(preL_to_hash)       << std::endl;
         std::cerr << "children: "           << arrayToString(children)           << std::endl;
         std::cerr << "nodeType_L: "         << arrayToString(nodeType_L)         << std::endl;
         std::cerr << "nodeType_R: "         << arrayToString(nodeType_R)         << std::endl;
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "CostModel.h"
+#include "node/NodeIndexer.h"
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// Prepared Tree
+//------------------------------------------------------------------------------
+
+/**
+ * A tree that is indexed once and then compared many times, e.g. a reference
+ * solution or an entry of a VPTree. Apted uses the stored indices directly
+ * instead of indexing both trees again for every comparison.
+ *
+ * <p>The indices depend on the cost model (subtree costs and hashes) so a
+ * prepared tree can only be compared by an algorithm using the same cost
+ * model. Apted keeps some traversal state in the indexer while it runs, so a
+ * prepared tree must not take part in two computations at the same time.
+ *
+ * <p>The node tree is not owned and has to outlive the prepared tree.
+ */
+
+template<class Data>
+class PreparedTree {
+private:
+    Node<Data>* root;
+    NodeIndexer<Data> indexer;
+
+public:
+    PreparedTree(Node<Data>* root, const CostModel<Data>* costModel)
+    : root(root)
+    , indexer(root, costModel) {
+        // nop
+    }
+
+    PreparedTree(const PreparedTree &other) = delete;
+    PreparedTree &operator=(const PreparedTree &other) = delete;
+
+    Node<Data>* getRoot() const {
+        return root;
+    }
+
+    NodeIndexer<Data>* getIndexer() {
+        return &indexer;
+    }
+
+    const CostModel<Data>* getCostModel() const {
+        return indexer.costModel;
+    }
+
+    int getSize() const {
+        return indexer.treeSize;
+    }
+
+    uint64_t getHash() const {
+        return indexer.preL_to_hash[0];
+    }
+};
+
+} // namespace capted
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// LRU Cache
+//------------------------------------------------------------------------------
+
+/**
+ * Bounded, thread safe LRU map from Key to immutable Entries, the common part
+ * of SubtreeCache and StrategyCache. Entry::getBytes() gives the size an entry
+ * is charged for against the capacity.
+ *
+ * <p>Entries are handed out as shared pointers, so the lock is only held for
+ * the lookup itself.
+ *
+ * <p>Each entry remembers the insertion that added it, so a copy of the cache,
+ * e.g. in a forked child, can hand what it added since some point back to the
+ * original with forEachInsertedSince().
+ */
+
+template<class Key, class Entry, class KeyHash>
+class LruCache {
+private:
+    struct LruItem {
+        Key key;
+        std::shared_ptr<const Entry> entry;
+        long insertion; // getInsertions() just after this was inserted
+    };
+
+    const size_t capacityBytes;
+    size_t sizeBytes;
+
+    long hits;
+    long misses;
+    long insertions;
+    long evictions;
+
+    std::list<LruItem> lru; // Most recently used first
+    std::unordered_map<Key, typename std::list<LruItem>::iterator, KeyHash> index;
+    mutable std::mutex mutex;
+
+    static size_t entryBytes(const Entry &entry) {
+        return sizeof(LruItem) + entry.getBytes();
+    }
+
+    void evict() {
+        while (sizeBytes > capacityBytes && !lru.empty()) {
+            sizeBytes -= entryBytes(*lru.back().entry);
+            index.erase(lru.back().key);
+            lru.pop_back();
+            evictions++;
+        }
+    }
+
+protected:
+    // An existing entry for key is either kept or replaced
+    void insertEntry(const Key &key, std::shared_ptr<const Entry> entry, bool replace) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            if (!replace) {
+                return;
+            }
+            sizeBytes -= entryBytes(*it->second->entry);
+            lru.erase(it->second);
+            index.erase(it);
+        }
+
+        insertions++;
+        lru.push_front(LruItem{key, entry, insertions});
+        index.insert(std::make_pair(key, lru.begin()));
+        sizeBytes += entryBytes(*entry);
+        evict();
+    }
+
+public:
+    LruCache(size_t capacityBytes)
+    : capacityBytes(capacityBytes)
+    , sizeBytes(0)
+    , hits(0)
+    , misses(0)
+    , insertions(0)
+    , evictions(0) {
+        // nop
+    }
+
+    size_t getCapacityBytes() const {
+        return capacityBytes;
+    }
+
+    std::shared_ptr<const Entry> find(const Key &key) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = index.find(key);
+        if (it == index.end()) {
+            misses++;
+            return nullptr;
+        }
+
+        hits++;
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->entry;
+    }
+
+    // Calls fn(key, entry) for every entry still cached that was inserted after
+    // getInsertions() returned insertion, least recently used first, so
+    // inserting them into another cache in that order keeps their recency.
+    template<class Fn>
+    void forEachInsertedSince(long insertion, Fn fn) const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto it = lru.rbegin(); it != lru.rend(); ++it) {
+            if (it->insertion > insertion) {
+                fn(it->key, *it->entry);
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // Counters
+    //-------------------------------------------------------------------------
+
+    long getHits() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hits;
+    }
+
+    long getMisses() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return misses;
+    }
+
+    long getInsertions() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return insertions;
+    }
+
+    // Counts lookups made on a copy of this cache, e.g. in a forked child
+    void addLookups(long hits, long misses) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->hits += hits;
+        this->misses += misses;
+    }
+
+    long getEvictions() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return evictions;
+    }
+
+    size_t getSizeBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sizeBytes;
+    }
+};
+
+} // namespace capted
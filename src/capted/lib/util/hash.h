@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+namespace capted {
+
+//------------------------------------------------------------------------------
+// hashCombine
+//------------------------------------------------------------------------------
+
+// Mixes value into seed (64-bit variant of boost::hash_combine). Order
+// sensitive so that it can be used for ordered children lists.
+inline uint64_t hashCombine(uint64_t seed, uint64_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 12) + (seed >> 4);
+    return seed;
+}
+
+} // namespace capted
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+#include "Capted.h"
+
+//------------------------------------------------------------------------------
+// Tree Generator
+//------------------------------------------------------------------------------
+
+// Random labelled trees for tests and benchmarks. Labels are single letters
+// drawn from the first numLabels letters of the alphabet.
+class TreeGenerator {
+private:
+    std::mt19937 rng;
+    int numLabels;
+
+    capted::Node<capted::StringNodeData>* newNode() {
+        std::string label(1, 'a' + rng() % numLabels);
+        return new capted::Node<capted::StringNodeData>(capted::StringNodeData(label));
+    }
+
+public:
+    TreeGenerator(unsigned int seed, int numLabels = 8)
+    : rng(seed)
+    , numLabels(numLabels) {
+        // nop
+    }
+
+    // Each new node is attached to a random existing node that has fewer than
+    // maxFanout children
+    capted::Node<capted::StringNodeData>* randomTree(int size, int maxFanout = 4) {
+        std::vector<capted::Node<capted::StringNodeData>*> nodes;
+        nodes.push_back(newNode());
+
+        while ((int)nodes.size() < size) {
+            capted::Node<capted::StringNodeData>* parent = nodes[rng() % nodes.size()];
+            if (parent->getNumChildren() >= maxFanout) {
+                continue;
+            }
+
+            capted::Node<capted::StringNodeData>* child = newNode();
+            parent->addChild(child);
+            nodes.push_back(child);
+        }
+
+        return nodes[0];
+    }
+
+    //--------------------------------------------------------------------------
+    // Shapes from the APTED papers. Left and right branch trees are the worst
+    // cases for left and right path decompositions, zig-zag trees for both.
+    //--------------------------------------------------------------------------
+
+    // A path of left children, each with a leaf as its right sibling
+    capted::Node<capted::StringNodeData>* leftBranchTree(int size) {
+        return branchTree(size, [](int depth) { return true; });
+    }
+
+    // A path of right children, each with a leaf as its left sibling
+    capted::Node<capted::StringNodeData>* rightBranchTree(int size) {
+        return branchTree(size, [](int depth) { return false; });
+    }
+
+    // A path that alternates between the left and the right child
+    capted::Node<capted::StringNodeData>* zigZagTree(int size) {
+        return branchTree(size, [](int depth) { return depth % 2 == 0; });
+    }
+
+    // Complete binary tree, filled level by level
+    capted::Node<capted::StringNodeData>* fullBinaryTree(int size) {
+        std::vector<capted::Node<capted::StringNodeData>*> nodes;
+
+        for (int i = 0; i < size; i++) {
+            nodes.push_back(newNode());
+            if (i > 0) {
+                nodes[(i - 1) / 2]->addChild(nodes[i]);
+            }
+        }
+
+        return nodes[0];
+    }
+
+    // Resembles a program AST: nested blocks with a wide list of statements,
+    // each statement a small and mostly binary expression tree
+    capted::Node<capted::StringNodeData>* astTree(int size) {
+        capted::Node<capted::StringNodeData>* root = newNode();
+        std::vector<capted::Node<capted::StringNodeData>*> blocks = {root};
+        int count = 1;
+
+        while (count < size) {
+            int action = rng() % 10;
+
+            if (action < 2 && blocks.size() < 6) {
+                // Open a nested block (if, loop, function body)
+                capted::Node<capted::StringNodeData>* block = newNode();
+                blocks.back()->addChild(block);
+                blocks.push_back(block);
+                count++;
+            } else if (action < 3 && blocks.size() > 1) {
+                // Close the innermost block
+                blocks.pop_back();
+            } else {
+                // A statement in the innermost block
+                int depth = rng() % 3;
+                blocks.back()->addChild(expressionTree(depth, size - count, count));
+            }
+        }
+
+        return root;
+    }
+
+    // Copy of tree with numEdits random relabels, so that trees generated from
+    // the same base form clusters under the edit distance
+    capted::Node<capted::StringNodeData>* mutate(capted::Node<capted::StringNodeData>* tree, int numEdits) {
+        std::vector<std::string> labels;
+        tree->dfs([&](capted::Node<capted::StringNodeData>* node, int depth) {
+            labels.push_back(node->getData()->getLabel());
+        });
+
+        for (int i = 0; i < numEdits; i++) {
+            labels[rng() % labels.size()] = std::string(1, 'a' + rng() % numLabels);
+        }
+
+        int i = 0;
+        return copyWithLabels(tree, labels, i);
+    }
+
+private:
+    template<class GoLeft>
+    capted::Node<capted::StringNodeData>* branchTree(int size, GoLeft goLeft) {
+        capted::Node<capted::StringNodeData>* root = newNode();
+        capted::Node<capted::StringNodeData>* current = root;
+        int count = 1;
+
+        for (int depth = 0; count < size; depth++) {
+            capted::Node<capted::StringNodeData>* left = newNode();
+            current->addChild(left);
+            count++;
+
+            if (count == size) {
+                break;
+            }
+
+            capted::Node<capted::StringNodeData>* right = newNode();
+            current->addChild(right);
+            count++;
+
+            current = goLeft(depth) ? left : right;
+        }
+
+        return root;
+    }
+
+    // Binary expression of at most the given depth and budget nodes. count is
+    // increased by the number of nodes created.
+    capted::Node<capted::StringNodeData>* expressionTree(int depth, int budget, int &count) {
+        capted::Node<capted::StringNodeData>* node = newNode();
+        count++;
+        budget--;
+
+        if (depth > 0 && budget >= 2) {
+            int before = count;
+            node->addChild(expressionTree(depth - 1, budget / 2, count));
+            budget -= count - before;
+            if (budget > 0) {
+                node->addChild(expressionTree(depth - 1, budget, count));
+            }
+        }
+
+        return node;
+    }
+
+    capted::Node<capted::StringNodeData>* copyWithLabels(capted::Node<capted::StringNodeData>* node, const std::vector<std::string> &labels, int &i) {
+        auto copy = new capted::Node<capted::StringNodeData>(capted::StringNodeData(labels[i++]));
+
+        for (capted::Node<capted::StringNodeData>* child : node->getChildren()) {
+            copy->addChild(copyWithLabels(child, labels, i));
+        }
+
+        return copy;
+    }
+};
@@ -1,8 +1,15 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <sstream>
+#include <thread>
 #include "includes/json.hpp"
 #include "Capted.h"
+#include "TreeGenerator.h"
 
 using namespace capted;
 using std::cout;
@@ -11,48 +18,650 @@ using std::string;
 using json = nlohmann::json;
 
 //------------------------------------------------------------------------------
-// Main
+// Correctness corpus
 //------------------------------------------------------------------------------
 
-void testEditDistance() {
+struct TestOptions {
+    int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<string> algorithms = {"apted", "apted-cache", "apted-compact", "apted-int32"};
+    std::vector<int> testsToRun = {};  // All if empty
+    std::vector<int> testsToSkip = {};
+    int minSize = 0;                   // Of the larger tree
+    int maxSize = std::numeric_limits<int>::max();
+    string baselineFile;               // Compare results and times against this file
+    string writeBaselineFile;          // Save results and times to this file
+    double maxSlowdown = 2.0;          // Relative to the baseline
+    long minTimeNs = 10 * 1000 * 1000; // Faster cases never count as slowdowns
+    bool corpusOnly = false;
+};
+
+struct TestCase {
+    int id;
+    float realDist;
+    Node<StringNodeData>* t1;
+    Node<StringNodeData>* t2;
+    int size;
+};
+
+struct TestRun {
+    const TestCase* test;
+    string algorithm;
+    float compDist;
+    long ns;
+};
+
+template<class Cost>
+float runApted(const TestCase &test, SubtreeCache* subtreeCache, bool innerPathArrays = true) {
+    StringCostModel costModel;
+    Apted<StringNodeData, Cost> algorithm(&costModel);
+    algorithm.setSubtreeCache(subtreeCache);
+    algorithm.setInnerPathArrays(innerPathArrays);
+    return algorithm.computeEditDistance(test.t1, test.t2);
+}
+
+// Every algorithm instance is used for one computation, but the cache is
+// shared by all threads and cases
+float runAlgorithm(const string &name, const TestCase &test, SubtreeCache &subtreeCache) {
+    if (name == "apted") {
+        return runApted<float>(test, nullptr);
+    } else if (name == "apted-cache") {
+        return runApted<float>(test, &subtreeCache);
+    } else if (name == "apted-compact") {
+        return runApted<float>(test, nullptr, false);
+    } else if (name == "apted-int16") {
+        return runApted<int16_t>(test, nullptr);
+    } else if (name == "apted-int32") {
+        return runApted<int32_t>(test, nullptr);
+    }
+
+    cout << "Unknown algorithm " << name << endl;
+    exit(1);
+}
+
+bool testEditDistance(const TestOptions &options) {
     std::ifstream testFile("./tests/correctness_test_cases.json");
     json testCases;
     testFile >> testCases;
 
-    std::vector<int> testsToRun = {};
-    std::vector<int> testsToSkip = {}; // {64, 71} are really slow without APTED algorithm
-
+    std::vector<TestCase> tests;
     for (json test : testCases) {
         int id = test["testID"];
         float realDist = test["d"];
         string t1 = test["t1"];
         string t2 = test["t2"];
 
-        if (std::find(testsToSkip.begin(), testsToSkip.end(), id) != testsToSkip.end()) {
-            // Skip slow tests
+        if (std::find(options.testsToSkip.begin(), options.testsToSkip.end(), id) != options.testsToSkip.end()) {
             continue;
         }
 
-        if (testsToRun.size() > 0 && std::find(testsToRun.begin(), testsToRun.end(), id) == testsToRun.end()) {
-            // Run specific tests?
+        if (options.testsToRun.size() > 0 && std::find(options.testsToRun.begin(), options.testsToRun.end(), id) == options.testsToRun.end()) {
             continue;
         }
 
-        StringCostModel costModel;
-        Apted<StringNodeData> algorithm(&costModel);
         BracketStringInputParser p1(t1);
         BracketStringInputParser p2(t2);
-        Node<StringNodeData>* n1 = p1.getRoot();
-        Node<StringNodeData>* n2 = p2.getRoot();
+        TestCase testCase = {id, realDist, p1.getRoot(), p2.getRoot(), 0};
+        testCase.size = std::max(testCase.t1->getNodeCount(), testCase.t2->getNodeCount());
+
+        if (testCase.size < options.minSize || testCase.size > options.maxSize) {
+            delete testCase.t1;
+            delete testCase.t2;
+            continue;
+        }
+
+        tests.push_back(testCase);
+    }
+
+    // One run per case and algorithm, handed out to the threads in order
+    std::vector<TestRun> runs;
+    for (const TestCase &test : tests) {
+        for (const string &algorithm : options.algorithms) {
+            runs.push_back({&test, algorithm, -1.0f, 0});
+        }
+    }
+
+    SubtreeCache subtreeCache(256 * 1024 * 1024);
+    std::atomic<size_t> nextRun(0);
+    auto worker = [&]() -> void {
+        size_t i;
+        while ((i = nextRun++) < runs.size()) {
+            auto start = std::chrono::steady_clock::now();
+            runs[i].compDist = runAlgorithm(runs[i].algorithm, *runs[i].test, subtreeCache);
+            runs[i].ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+    };
+
+    auto corpusStart = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.numThreads; t++) {
+        threads.push_back(std::thread(worker));
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    auto corpusEnd = std::chrono::steady_clock::now();
+
+    json baseline;
+    if (!options.baselineFile.empty()) {
+        std::ifstream baselineStream(options.baselineFile);
+        if (!baselineStream) {
+            cout << "Cannot read baseline " << options.baselineFile << endl;
+            return false;
+        }
+        baselineStream >> baseline;
+    }
+
+    bool passed = true;
+    json results;
+
+    for (const TestRun &run : runs) {
+        string id = std::to_string(run.test->id);
+        bool ok = (run.compDist == run.test->realDist);
+        std::stringstream note;
+
+        if (!ok) {
+            note << " (got " << run.compDist << ", expected " << run.test->realDist << ")";
+        }
+
+        if (baseline.count(run.algorithm) && baseline[run.algorithm].count(id)) {
+            json &expected = baseline[run.algorithm][id];
+            float baselineDist = expected["d"];
+            long baselineNs = expected["ns"];
+
+            if (run.compDist != baselineDist) {
+                ok = false;
+                note << " (baseline " << baselineDist << ")";
+            } else if (run.ns > options.minTimeNs && run.ns > options.maxSlowdown * baselineNs) {
+                ok = false;
+                note << " (slowdown " << (double)run.ns / baselineNs << "x)";
+            }
+        }
+
+        std::stringstream ms;
+        ms << std::fixed << std::setprecision(3) << run.ns / 1000000.0 << "ms";
+
+        cout << std::setw(3) << run.test->id << " "
+             << std::setw(12) << std::left << run.algorithm << std::right
+             << std::setw(6) << run.test->size << " nodes "
+             << std::setw(12) << ms.str() << " "
+             << (ok ? "✓" : "FAIL") << note.str() << endl;
+
+        passed &= ok;
+        results[run.algorithm][id] = {{"d", run.compDist}, {"ns", run.ns}};
+    }
+
+    cout << "Corpus " << (passed ? "✓" : "FAIL") << " "
+         << runs.size() << " runs on " << options.numThreads << " threads in "
+         << std::chrono::duration_cast<std::chrono::milliseconds>(corpusEnd - corpusStart).count() << "ms" << endl;
+
+    if (!options.writeBaselineFile.empty()) {
+        std::ofstream baselineStream(options.writeBaselineFile);
+        baselineStream << std::setw(2) << results << endl;
+    }
+
+    for (const TestCase &test : tests) {
+        delete test.t1;
+        delete test.t2;
+    }
+
+    return passed;
+}
+
+bool testNode() {
+    StringCostModel costModel;
+    TreeGenerator generator(13);
+    Node<StringNodeData>* tree = generator.astTree(200);
+
+    // A clone is a deep copy
+    Node<StringNodeData>* copy = tree->clone();
+    Apted<StringNodeData> algorithm(&costModel);
+    bool passed = (algorithm.computeEditDistance(tree, copy) == 0.0f);
+    passed &= (copy->getNodeCount() == tree->getNodeCount());
+    passed &= (copy->getData() != tree->getData());
+
+    // Moving a node takes its children along
+    Node<StringNodeData> moved(std::move(*copy));
+    passed &= (copy->getNumChildren() == 0);
+    passed &= (moved.getNodeCount() == tree->getNodeCount());
+    for (Node<StringNodeData>* child : moved.getChildren()) {
+        passed &= (child->getParent() == &moved);
+    }
+
+    cout << "Node " << (passed ? "✓" : "FAIL") << endl;
+
+    delete copy;
+    delete tree;
+
+    return passed;
+}
+
+bool testMetricIndex() {
+    const int corpusSize = 100;
+    const int numQueries = 10;
+    const int k = 5;
+
+    StringCostModel costModel;
+    TreeGenerator generator(42);
+
+    // Clusters of small variations around a few base trees, like submissions
+    // to the same assignment. See bench_runner --vptree for timings on a
+    // larger corpus.
+    std::vector<Node<StringNodeData>*> bases;
+    for (int i = 0; i < 10; i++) {
+        bases.push_back(generator.randomTree(30));
+    }
+
+    std::vector<Node<StringNodeData>*> nodes;
+    std::vector<PreparedTree<StringNodeData>*> corpus;
+    for (int i = 0; i < corpusSize; i++) {
+        nodes.push_back(generator.mutate(bases[i % bases.size()], i % 7));
+        corpus.push_back(new PreparedTree<StringNodeData>(nodes.back(), &costModel));
+    }
+
+    VPTree<StringNodeData> index(corpus, &costModel);
+    long buildDistances = index.getDistanceCount();
+    long indexDistances = 0;
+    long bruteDistances = 0;
+    bool passed = true;
+
+    for (int q = 0; q < numQueries; q++) {
+        Node<StringNodeData>* queryNode = generator.mutate(bases[q % bases.size()], 3);
+        PreparedTree<StringNodeData> query(queryNode, &costModel);
+
+        long before = index.getDistanceCount();
+        auto neighbours = index.knn(&query, k);
+        indexDistances += index.getDistanceCount() - before;
+
+        std::vector<float> distances;
+        for (PreparedTree<StringNodeData>* tree : corpus) {
+            Apted<StringNodeData> algorithm(&costModel);
+            distances.push_back(algorithm.computeEditDistance(&query, tree));
+            bruteDistances++;
+        }
+        std::sort(distances.begin(), distances.end());
+
+        // Ties may be broken differently so only the distances are compared
+        passed &= ((int)neighbours.size() == k);
+        for (int i = 0; i < (int)neighbours.size(); i++) {
+            passed &= (neighbours[i].distance == distances[i]);
+        }
+
+        auto inRange = index.range(&query, distances[k - 1]);
+        passed &= (inRange.size() == (size_t)(std::upper_bound(distances.begin(), distances.end(), distances[k - 1]) - distances.begin()));
+
+        delete queryNode;
+    }
+
+    // The index has to prune something to be worth having
+    passed &= (indexDistances < bruteDistances);
+
+    cout << "VPTree " << (passed ? "✓" : "FAIL") << endl;
+    cout << "    build: " << buildDistances << " distances" << endl;
+    cout << "    knn:   " << indexDistances << " distances" << endl;
+    cout << "    brute: " << bruteDistances << " distances" << endl;
+
+    for (PreparedTree<StringNodeData>* tree : corpus) {
+        delete tree;
+    }
+    for (Node<StringNodeData>* node : nodes) {
+        delete node;
+    }
+    for (Node<StringNodeData>* node : bases) {
+        delete node;
+    }
+
+    return passed;
+}
+
+bool testSimilarityJoin() {
+    const int numTrees = 50;
+    const float tau = 4.0f;
+
+    StringCostModel costModel;
+    TreeGenerator generator(7);
+
+    // See bench_runner --join for timings on a larger corpus
+    std::vector<Node<StringNodeData>*> bases;
+    for (int i = 0; i < 10; i++) {
+        bases.push_back(generator.randomTree(20 + i));
+    }
+
+    std::vector<Node<StringNodeData>*> trees;
+    for (int i = 0; i < numTrees; i++) {
+        trees.push_back(generator.mutate(bases[i % bases.size()], i % 8));
+    }
 
-        float compDist = algorithm.computeEditDistance(n1, n2);
-        cout << std::setw(3) << id << " " << (realDist == compDist ? "✓" : "FAIL") << endl;
+    SimilarityJoin<StringNodeData> join(&costModel, tau);
+    auto matches = join.selfJoin(trees);
 
-        delete n1;
-        delete n2;
+    std::vector<std::pair<int, int>> expected;
+    for (int i = 0; i < numTrees; i++) {
+        for (int j = i + 1; j < numTrees; j++) {
+            Apted<StringNodeData> algorithm(&costModel);
+            if (algorithm.computeEditDistance(trees[i], trees[j]) <= tau) {
+                expected.push_back(std::make_pair(i, j));
+            }
+        }
+    }
+
+    bool passed = (matches.size() == expected.size());
+    for (size_t i = 0; passed && i < matches.size(); i++) {
+        passed &= (std::make_pair(matches[i].first, matches[i].second) == expected[i]);
+    }
+
+    auto stats = join.getStats();
+    cout << "SimilarityJoin " << (passed ? "✓" : "FAIL") << endl;
+    cout << "    pairs: " << stats.pairs << ", filtered by size " << stats.sizeFiltered << ", histogram " << stats.histogramFiltered << ", traversal " << stats.traversalFiltered << endl;
+    cout << "    verified: " << stats.verified << ", matches " << stats.matches << endl;
+
+    for (Node<StringNodeData>* node : trees) {
+        delete node;
+    }
+    for (Node<StringNodeData>* node : bases) {
+        delete node;
+    }
+
+    return passed;
+}
+
+bool testBudget() {
+    const int numPairs = 100;
+
+    StringCostModel costModel;
+    TreeGenerator generator(11);
+
+    int exact = 0;
+    int approximate = 0;
+    bool passed = true;
+
+    for (int i = 0; i < numPairs; i++) {
+        Node<StringNodeData>* t1 = generator.randomTree(10 + i);
+        Node<StringNodeData>* t2 = generator.mutate(t1, i % 10);
+
+        Apted<StringNodeData> reference(&costModel);
+        float distance = reference.computeEditDistance(t1, t2);
+        float predicted = reference.getPredictedSubproblemCount();
+
+        // Every other pair is over its subproblem budget
+        Apted<StringNodeData> bySubproblems(&costModel);
+        bySubproblems.setSubproblemBudget(i % 2 == 0 ? predicted : predicted - 1);
+        EditDistanceResult result = bySubproblems.computeBoundedEditDistance(t1, t2);
+
+        if (result.approximate) {
+            approximate++;
+            passed &= (result.lowerBound <= distance && distance <= result.upperBound);
+            passed &= (result.distance == result.upperBound);
+        } else {
+            exact++;
+            passed &= (result.distance == distance);
+        }
+        passed &= (result.approximate == (i % 2 == 1 && predicted > 0));
+
+        // Out of time before the first single-path function
+        Apted<StringNodeData> byTime(&costModel);
+        byTime.setTimeBudget(std::chrono::nanoseconds(0));
+        result = byTime.computeBoundedEditDistance(t1, t2);
+        passed &= (result.lowerBound <= distance && distance <= result.upperBound);
+
+        delete t1;
+        delete t2;
+    }
+
+    // The memory budget counts the single-path tables next to delta, which
+    // are larger than delta on their own
+    Node<StringNodeData>* big1 = generator.randomTree(60);
+    Node<StringNodeData>* big2 = generator.mutate(big1, 10);
+    size_t deltaBytes = 60 * 60 * sizeof(float);
+
+    Apted<StringNodeData> unbudgeted(&costModel);
+    float bigDistance = unbudgeted.computeEditDistance(big1, big2);
+
+    bool exceeded = false;
+    try {
+        Apted<StringNodeData> failing(&costModel);
+        failing.setMemoryBudget(deltaBytes, BudgetPolicy::FAIL);
+        failing.computeEditDistance(big1, big2);
+    } catch (const MemoryBudgetExceeded &e) {
+        exceeded = (e.deltaBytes == deltaBytes && e.requiredBytes > 2 * deltaBytes);
     }
+    passed &= exceeded;
+
+    Apted<StringNodeData> approximating(&costModel);
+    approximating.setMemoryBudget(deltaBytes, BudgetPolicy::APPROXIMATE);
+    passed &= approximating.computeBoundedEditDistance(big1, big2).approximate;
+
+    // Delta and every table in files
+    Apted<StringNodeData> fileBacked(&costModel);
+    fileBacked.setMemoryBudget(0, BudgetPolicy::FILE_BACKED);
+    passed &= (fileBacked.computeEditDistance(big1, big2) == bigDistance);
+
+    delete big1;
+    delete big2;
+
+    // Path IDs go up to size1 + size2, past what int16_t holds
+    Node<StringNodeData>* star1 = generator.randomTree(1);
+    Node<StringNodeData>* star2 = generator.randomTree(1);
+    for (int i = 0; i < 20000; i++) {
+        star1->addChild(generator.randomTree(1));
+        star2->addChild(generator.randomTree(1));
+    }
+
+    bool overflowed = false;
+    try {
+        Apted<StringNodeData, int16_t> narrow(&costModel);
+        narrow.computeEditDistance(star1, star2);
+    } catch (const CostTypeOverflow &e) {
+        overflowed = true;
+    }
+    passed &= overflowed;
+
+    delete star1;
+    delete star2;
+
+    cout << "Budget " << (passed ? "✓" : "FAIL") << endl;
+    cout << "    " << exact << " exact, " << approximate << " approximate" << endl;
+
+    return passed;
+}
+
+bool testPrediction() {
+    StringCostModel costModel;
+    TreeGenerator generator(17);
+    bool passed = true;
+    double ratioSum = 0;
+    int pairs = 0;
+
+    std::vector<std::function<Node<StringNodeData>*(int size)>> shapes = {
+        [&](int size) { return generator.randomTree(size); },
+        [&](int size) { return generator.zigZagTree(size); },
+        [&](int size) { return generator.fullBinaryTree(size); },
+        [&](int size) { return generator.astTree(size); },
+    };
+
+    for (auto &shape1 : shapes) {
+        for (auto &shape2 : shapes) {
+            Node<StringNodeData>* t1 = shape1(100);
+            Node<StringNodeData>* t2 = shape2(120);
+
+            Apted<StringNodeData> predictor(&costModel);
+            float estimate = predictor.estimateCost(t1, t2);
+            float predicted = predictor.predictCost(t1, t2);
+
+            // The prediction is the cost of the strategy the computation uses
+            Apted<StringNodeData> algorithm(&costModel);
+            algorithm.computeEditDistance(t1, t2);
+            passed &= (predicted == algorithm.getPredictedSubproblemCount());
+            passed &= (estimate >= predicted * 0.999f);
+
+            ratioSum += estimate / predicted;
+            pairs++;
+
+            delete t1;
+            delete t2;
+        }
+    }
+
+    // Identical trees return before the strategy, so no counts are carried
+    // over from the previous pair
+    Node<StringNodeData>* t1 = generator.randomTree(100);
+    Node<StringNodeData>* t2 = generator.randomTree(100);
+    Apted<StringNodeData> reused(&costModel);
+    reused.computeEditDistance(t1, t2);
+    reused.computeEditDistance(t1, t1);
+    passed &= (reused.getPredictedSubproblemCount() == 0 && reused.getSubproblemCount() == 0);
+    delete t1;
+    delete t2;
+
+    cout << "Prediction " << (passed ? "✓" : "FAIL") << endl;
+    cout << "    estimate / predicted: " << ratioSum / pairs << " on average" << endl;
+
+    return passed;
+}
+
+bool testStrategyCache() {
+    StringCostModel costModel;
+    TreeGenerator generator(19);
+    StrategyCache strategyCache(16 * 1024 * 1024);
+    bool passed = true;
+
+    // Relabelled copies keep the shape of their base tree
+    Node<StringNodeData>* base1 = generator.astTree(120);
+    Node<StringNodeData>* base2 = generator.randomTree(100);
+
+    for (int i = 0; i < 8; i++) {
+        Node<StringNodeData>* t1 = generator.mutate(base1, 10);
+        Node<StringNodeData>* t2 = generator.mutate(base2, 10);
+
+        Apted<StringNodeData> uncached(&costModel);
+        float expected = uncached.computeEditDistance(t1, t2);
+
+        Apted<StringNodeData> cached(&costModel);
+        cached.setStrategyCache(&strategyCache);
+        passed &= (cached.computeEditDistance(t1, t2) == expected);
+        passed &= (cached.getPredictedSubproblemCount() == uncached.getPredictedSubproblemCount());
+
+        delete t1;
+        delete t2;
+    }
+
+    passed &= (strategyCache.getMisses() == 1 && strategyCache.getHits() == 7);
+
+    // What a copy of the cache added, handed back as a forked child would
+    StrategyCache parentCache(16 * 1024 * 1024);
+    strategyCache.forEachInsertedSince(0, [&](const StrategyCache::Key &key, const StrategyCache::Entry &entry) {
+        parentCache.insert(key, std::make_shared<StrategyCache::Entry>(entry));
+    });
+    parentCache.addLookups(strategyCache.getHits(), strategyCache.getMisses());
+    passed &= (parentCache.getSizeBytes() == strategyCache.getSizeBytes());
+
+    Node<StringNodeData>* t1 = generator.mutate(base1, 10);
+    Node<StringNodeData>* t2 = generator.mutate(base2, 10);
+    Apted<StringNodeData> inherited(&costModel);
+    inherited.setStrategyCache(&parentCache);
+    inherited.computeEditDistance(t1, t2);
+    passed &= (parentCache.getMisses() == 1 && parentCache.getHits() == 8);
+    passed &= (parentCache.getInsertions() == 1);
+    delete t1;
+    delete t2;
+
+    cout << "StrategyCache " << (passed ? "✓" : "FAIL") << endl;
+    cout << "    hits: " << strategyCache.getHits() << ", misses: " << strategyCache.getMisses() << endl;
+
+    delete base1;
+    delete base2;
+    return passed;
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+std::vector<string> splitList(const string &s) {
+    std::vector<string> items;
+    std::stringstream ss(s);
+    string item;
+    while (std::getline(ss, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+std::vector<int> splitIntList(const string &s) {
+    std::vector<int> items;
+    for (const string &item : splitList(s)) {
+        items.push_back(std::stoi(item));
+    }
+    return items;
+}
+
+void printUsage(const char* name) {
+    cout << "Usage: " << name << " [options]" << endl;
+    cout << "    --threads=n              worker threads for the corpus (default: all cores)" << endl;
+    cout << "    --algorithms=a,b,...     apted, apted-cache, apted-compact, apted-int16, apted-int32 (default: all but int16)" << endl;
+    cout << "    --ids=a,b,...            only run these test IDs" << endl;
+    cout << "    --skip=a,b,...           skip these test IDs" << endl;
+    cout << "    --sizes=min:max          only run cases whose larger tree is in range" << endl;
+    cout << "    --baseline=file          fail on results or times that regress from file" << endl;
+    cout << "    --write-baseline=file    save results and times to file" << endl;
+    cout << "    --max-slowdown=x         allowed time relative to the baseline (default: 2.0)" << endl;
+    cout << "    --min-time-ms=n          never flag faster cases as slowdowns (default: 10)" << endl;
+    cout << "    --corpus-only            skip the other tests" << endl;
+}
+
+bool parseOptions(int argc, char const *argv[], TestOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq);
+        string value = (eq == string::npos) ? "" : arg.substr(eq + 1);
+
+        if (key == "--threads") {
+            options.numThreads = std::max(1, std::stoi(value));
+        } else if (key == "--algorithms") {
+            options.algorithms = splitList(value);
+        } else if (key == "--ids") {
+            options.testsToRun = splitIntList(value);
+        } else if (key == "--skip") {
+            options.testsToSkip = splitIntList(value);
+        } else if (key == "--sizes") {
+            if (sscanf(value.c_str(), "%d:%d", &options.minSize, &options.maxSize) != 2) {
+                return false;
+            }
+        } else if (key == "--baseline") {
+            options.baselineFile = value;
+        } else if (key == "--write-baseline") {
+            options.writeBaselineFile = value;
+        } else if (key == "--max-slowdown") {
+            options.maxSlowdown = std::stod(value);
+        } else if (key == "--min-time-ms") {
+            options.minTimeNs = std::stol(value) * 1000 * 1000;
+        } else if (key == "--corpus-only") {
+            options.corpusOnly = true;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 int main(int argc, char const *argv[]) {
-    testEditDistance();
+    TestOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    bool passed = testEditDistance(options);
+
+    if (!options.corpusOnly) {
+        passed &= testNode();
+        passed &= testMetricIndex();
+        passed &= testSimilarityJoin();
+        passed &= testBudget();
+        passed &= testPrediction();
+        passed &= testStrategyCache();
+    }
+
+    return passed ? 0 : 1;
 }
@@ -6,7 +6,7 @@ from multiprocessing import Pool
 from contextlib import closing
 from functools import partial
 
-from run import compile_llvm, run_a1
+from run import compile_llvm, run_a1_batch
 import constants
 
 
@@ -17,15 +17,21 @@ def evaluate(reference_solution, student_solutions):
     label           = reference_solution['label']
     solution_dirs   = [reference_solution['src']]
     output_file     = 'output/{}.stdout'.format(label)
+    results_file    = 'output/{}.results'.format(label)
+    manifest_prefix = 'output/{}'.format(label)
     output_hist_img = 'output/{}-hist.png'.format(label)
     output_dist_img = 'output/{}-dist.png'.format(label)
     output_mark_img = 'output/{}-mark.png'.format(label)
 
+    # Edit distances are appended to the results file, which is started afresh
+    if os.path.exists(results_file):
+        os.remove(results_file)
+
     # Can't parallelize by student solutions because they share the same output stream
     # Can only parallelize by reference solution
     with open(output_file, 'w') as output_stream, open(os.devnull, 'w') as debug_stream:
-        for student_solution in student_solutions:
-            run_a1(solution_dirs, student_solution['src'], output_stream, debug_stream)
+        student_dirs = [student_solution['src'] for student_solution in student_solutions]
+        run_a1_batch(solution_dirs, student_dirs, manifest_prefix, output_stream, debug_stream, results_file=results_file)
 
 
 def batch_a1(reference_solutions, student_solutions):
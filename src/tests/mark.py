@@ -63,7 +63,9 @@ def get_edit_distances(src_file_name, student_ids, edit_distances_dir):
     # Collect marks from each solution output
     for solution_idx, solution in enumerate(constants.REFERENCE_SOLUTIONS):
         solution_label = solution['label']
-        data_file = '{}/{}.stdout'.format(edit_distances_dir, solution_label)
+        data_file = '{}/{}.results'.format(edit_distances_dir, solution_label)
+        if not os.path.isfile(data_file):
+            data_file = '{}/{}.stdout'.format(edit_distances_dir, solution_label)
 
         # Collect raw edit distances
         edit_distances = parse_output_file(student_ids, data_file, src_file_name)
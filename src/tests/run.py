@@ -30,6 +30,20 @@ CLANG_FLAGS = [
     '-I', CXX_HEADERS # c++ headers
 ]
 
+ARCHIVE_EXTENSIONS = ('.tar', '.tar.gz', '.tgz', '.zip')
+
+A1_CFLAGS = ['-lpng', '-lcurl']
+A1_PARTS  = [
+    {
+        'marker': 'a1nbio',
+        'file': 'paster_nbio.c'
+    },
+    {
+        'marker': 'a1parallel',
+        'file': 'paster_parallel.c'
+    }
+]
+
 
 #------------------------------------------------------------------------------
 
@@ -41,11 +55,41 @@ def compile_llvm():
     return subprocess.call(argv, cwd=LLVM_BUILD_DIR)
 
 
-def run_compiler(reference_solution_files, student_solution_file, marker, assn_cxx_flags, output_stream, debug_stream):
+def student_solution_path(student, file):
+    """Submission archives are passed as is, clang-automarker finds the file
+    in them with -cam-archive-member, or by the name of the references."""
+    if student.endswith(ARCHIVE_EXTENSIONS):
+        return student
+    return '{}/{}'.format(student, file)
+
+
+def run_compiler(reference_solution_files, student_solution_file, marker, assn_cxx_flags, output_stream, debug_stream, student_manifest=None, archive_member=None, results_file=None):
     argv = [CAM_TOOL_EXEC]
     argv.extend(['-cam-reference-solution={}'.format(','.join(reference_solution_files))])
     argv.extend(['-cam-marker={}'.format(marker)])
-    argv.extend([student_solution_file])
+    if student_manifest is not None:
+        argv.extend(['-cam-student-manifest={}'.format(student_manifest)])
+    if archive_member is not None:
+        argv.extend(['-cam-archive-member={}'.format(archive_member)])
+    if results_file is not None:
+        argv.extend(['-cam-results-format=columnar', '-cam-results={}'.format(results_file)])
+    if student_solution_file is not None:
+        argv.extend([student_solution_file])
+
+    argv.extend(['--'])
+    argv.extend(assn_cxx_flags)
+    argv.extend(CLANG_FLAGS)
+
+    logger.debug(' '.join(argv))
+    return subprocess.call(argv, stdout=output_stream, stderr=debug_stream)
+
+
+def run_compiler_parts(parts, assn_cxx_flags, output_stream, debug_stream):
+    """Marks several (marker, student file, reference files) parts in one
+    clang-automarker run."""
+    argv = [CAM_TOOL_EXEC]
+    for marker, student_solution_file, reference_solution_files in parts:
+        argv.extend(['-cam-marker={}={}={}'.format(marker, student_solution_file, ','.join(reference_solution_files))])
 
     argv.extend(['--'])
     argv.extend(assn_cxx_flags)
@@ -58,25 +102,34 @@ def run_compiler(reference_solution_files, student_solution_file, marker, assn_c
 def run_a1(reference_folders, student_folder, output_stream, debug_stream):
     logger.info("Running a1 on Student:{} Solutions:{}".format(student_folder, reference_folders))
 
-    cflags = ['-lpng', '-lcurl']
-    parts = [
-        {
-            'marker': 'a1nbio',
-            'file': 'paster_nbio.c'
-        },
-        {
-            'marker': 'a1parallel',
-            'file': 'paster_parallel.c'
-        }
-    ]
-
-    for part in parts:
+    parts = []
+    for part in A1_PARTS:
+        reference_solutions = ['{}/{}'.format(rf, part['file']) for rf in reference_folders]
+        student_solution = student_solution_path(student_folder, part['file'])
+        parts.append((part['marker'], student_solution, reference_solutions))
+
+    ret = run_compiler_parts(parts, A1_CFLAGS, output_stream, debug_stream)
+    if ret != 0:
+        logger.error("Failed to mark {}".format(student_folder))
+
+
+def run_a1_batch(reference_folders, student_folders, manifest_prefix, output_stream, debug_stream, results_file=None):
+    """Marks all students in one clang-automarker run per part, so that the
+    reference solutions are only parsed once. Each student is still marked in
+    its own forked process. With a results_file, the edit distances are
+    appended to it in columnar form instead of printed (see util.read_results)."""
+    logger.info("Running a1 on {} Students Solutions:{}".format(len(student_folders), reference_folders))
+
+    for part in A1_PARTS:
         reference_solutions = ['{}/{}'.format(rf, part['file']) for rf in reference_folders]
-        student_solution = '{}/{}'.format(student_folder, part['file'])
+        manifest_file = '{}-{}.manifest'.format(manifest_prefix, part['marker'])
+        with open(manifest_file, 'w') as manifest:
+            for student_folder in student_folders:
+                manifest.write('{}\n'.format(student_solution_path(student_folder, part['file'])))
 
-        ret = run_compiler(reference_solutions, student_solution, part['marker'], cflags, output_stream, debug_stream)
+        ret = run_compiler(reference_solutions, None, part['marker'], A1_CFLAGS, output_stream, debug_stream, student_manifest=manifest_file, archive_member=part['file'], results_file=results_file)
         if ret != 0:
-            logger.error("Failed to mark {}".format(student_folder))
+            logger.error("Failed to mark some students for {}, see the debug output".format(part['marker']))
 
 
 def parse_args():
@@ -88,7 +141,7 @@ def parse_args():
     parser.add_argument('--debugFile',
                         help="File to pipe stderr (debug info)")
     parser.add_argument('--student', default='ece459-a1/sample-solutions/student1/src',
-                        help="Student solution directory to mark")
+                        help="Student solution directory, or submission archive, to mark")
     parser.add_argument('--reference', default=['ece459-a1/sample-solutions/student2/src'], action='append',
                         help="Reference solutions' directory")
     return parser.parse_args()
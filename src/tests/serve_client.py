@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+
+
+import argparse
+import os
+import socket
+import sys
+
+
+#------------------------------------------------------------------------------
+# Stands in for the submission server against a clang-automarker daemon, e.g.
+#
+#   clang-automarker -cam-serve=/tmp/cam.sock \
+#       -cam-serve-marker=a1nbio=ref/paster_nbio.c \
+#       -cam-serve-marker=a1parallel=ref/paster_parallel.c -- -lpng -lcurl ...
+#
+#   ./serve_client.py --socket /tmp/cam.sock --marker a1nbio student1/src/paster_nbio.c
+#------------------------------------------------------------------------------
+
+
+def request(socket_path, marker, student_file, send_source, output_stream):
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+        s.connect(socket_path)
+
+        if send_source:
+            with open(student_file, 'rb') as f:
+                source = f.read()
+            # <student>/src/<file>, which is how tests/util.py finds the student
+            name = '/'.join(os.path.abspath(student_file).split('/')[-3:])
+            s.sendall('SOURCE {} {} {}\n'.format(marker, name, len(source)).encode() + source)
+        else:
+            s.sendall('FILE {} {}\n'.format(marker, os.path.abspath(student_file)).encode())
+
+        # Results are streamed as they are printed, the last line is END ...
+        last_line = b''
+        while True:
+            data = s.recv(65536)
+            if not data:
+                break
+            output_stream.write(data.decode(errors='replace'))
+            output_stream.flush()
+            last_line = (last_line + data).rstrip(b'\n').split(b'\n')[-1]
+
+        return last_line.decode(errors='replace')
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description='Test client for clang-automarker -cam-serve')
+    parser.add_argument('--socket', required=True,
+                        help="Socket the daemon listens on")
+    parser.add_argument('--marker', required=True,
+                        help="Marker to use (a1nbio, a1parallel)")
+    parser.add_argument('--source', default=False, action='store_true',
+                        help="Send the file contents instead of its path")
+    parser.add_argument('student', nargs='+',
+                        help="Student solution files to mark")
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+
+    failed = False
+    for student_file in args.student:
+        end = request(args.socket, args.marker, student_file, args.source, sys.stdout)
+        failed |= (end != 'END ok')
+
+    exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -4,6 +4,7 @@ import colorlog
 import re
 import os
 import collections
+import json
 
 
 logger = logging.getLogger('ClangAutoMarker')
@@ -52,6 +53,75 @@ def print_globals():
 #------------------------------------------------------------------------------
 
 
+RESULTS_MAGIC = b'CAMR'
+RESULTS_COLUMNS = [
+    ('stuFile', '<u4'),
+    ('refFile', '<u4'),
+    ('stuFn', '<u4'),
+    ('refFn', '<u4'),
+    ('diff', '<f4'),
+    ('lowerBound', '<f4'),
+    ('upperBound', '<f4'),
+    ('approx', '<u1'),
+    ('stuNodes', '<i4'),
+    ('refNodes', '<i4'),
+    ('micros', '<i8'),
+]
+RESULTS_STRING_COLUMNS = ['stuFile', 'refFile', 'stuFn', 'refFn']
+
+
+def read_columnar_results(data_file):
+    """Yields a dict of numpy columns per block of a -cam-results-format=columnar
+    file, see ColumnarResultSink. File and function names are decoded."""
+    with open(data_file, 'rb') as f:
+        data = f.read()
+
+    pos = 0
+    while pos < len(data):
+        magic, version, num_rows, num_strings = np.frombuffer(data, dtype='<u4', count=4, offset=pos)
+        if data[pos:pos + 4] != RESULTS_MAGIC or version != 1:
+            raise ValueError('{} is not a results file'.format(data_file))
+        pos += 16
+
+        strings = []
+        for _ in range(num_strings):
+            length = int(np.frombuffer(data, dtype='<u4', count=1, offset=pos)[0])
+            strings.append(data[pos + 4:pos + 4 + length].decode('utf-8', 'replace'))
+            pos += 4 + length
+        strings = np.array(strings, dtype=object)
+
+        block = {}
+        for name, dtype in RESULTS_COLUMNS:
+            column = np.frombuffer(data, dtype=dtype, count=num_rows, offset=pos)
+            pos += column.nbytes
+            block[name] = strings[column] if name in RESULTS_STRING_COLUMNS else column
+        yield block
+
+
+def read_results(data_file):
+    """Yields (student file, reference file, student function, reference
+    function, diff) for each comparison in a clang-automarker results file,
+    whether text, jsonl or columnar."""
+    with open(data_file, 'rb') as f:
+        magic = f.read(len(RESULTS_MAGIC))
+
+    if magic == RESULTS_MAGIC:
+        for block in read_columnar_results(data_file):
+            yield from zip(block['stuFile'], block['refFile'], block['stuFn'], block['refFn'], block['diff'])
+        return
+
+    with open(data_file, 'r') as f:
+        for curr_line in f:
+            if curr_line.startswith('{'):
+                row = json.loads(curr_line)
+                yield row['stuFile'], row['refFile'], row['stuFn'], row['refFn'], row['diff']
+                continue
+
+            match = re.search('^stuFile:(\S+) refFile:(\S+) stuFn:(\w+) refFn:(\w+) diff:(\d+)', curr_line)
+            if match is not None:
+                yield match.group(1), match.group(2), match.group(3), match.group(4), int(match.group(5))
+
+
 def parse_output_file(student_ids, data_file, src_file_name):
     n = len(student_ids)
     edit_distances = np.zeros(n)
@@ -61,24 +131,20 @@ def parse_output_file(student_ids, data_file, src_file_name):
         logger.warn('No data file {} found'.format(data_file))
         return edit_distances
 
-    with open(data_file, 'r') as f:
-        for curr_line in f:
-            # Check if we found the current student's mark
-            path_pattern = '[/[\w-]+]?/{}\.c'.format(src_file_name)
-            pattern = '^stuFile:({}) refFile:({}) stuFn:(\w+) refFn:(\w+) diff:(\d+)'.format(path_pattern, path_pattern)
-            match = re.search(pattern, curr_line)
-            if match is None:
-                continue
+    path_pattern = re.compile('^[/[\w-]+]?/{}\.c$'.format(src_file_name))
+    for stu_file, ref_file, stu_fn, ref_fn, dist in read_results(data_file):
+        # Check if we found the current student's mark
+        if path_pattern.match(stu_file) is None or path_pattern.match(ref_file) is None:
+            continue
 
-            curr_student = match.group(1).split('/')[-3].lower()
-            dist = int(match.group(5))
+        curr_student = stu_file.split('/')[-3].lower()
 
-            if curr_student not in idx_map:
-                logger.warn('parse_output_file: Found student {} in {} but is not registered'.format(curr_student, data_file))
-                continue
+        if curr_student not in idx_map:
+            logger.warn('parse_output_file: Found student {} in {} but is not registered'.format(curr_student, data_file))
+            continue
 
-            i = idx_map[curr_student]
-            edit_distances[i] = edit_distances[i] + dist
+        i = idx_map[curr_student]
+        edit_distances[i] = edit_distances[i] + dist
 
     return edit_distances
 